@@ -0,0 +1,143 @@
+/*
+MIT License
+
+Copyright (c) 2023 Eric Fry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <algorithm>
+#include <iostream>
+#include "archive.h"
+#include "file.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define TD3EXTRACT_USE_MMAP
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+// Largest single write() used when the kernel can't copy between the files directly.
+constexpr size_t ARCHIVE_WRITE_CHUNK_SIZE = 0x100000;
+
+std::string ArchiveSet::getArchiveFilename(short archiveFileId, const std::string &dataFilename) {
+    switch (archiveFileId) {
+        case 'a' : return "DATAA.DAT";
+        case 'b' : return "DATAB.DAT";
+        case 'c' : return "DATAC.DAT";
+        case 'd' :
+        case 'e' : return dataFilename;
+        default: return "";
+    }
+}
+
+bool ArchiveSet::getEntry(const DataArchiveFileStruct &fileInfo, const std::string &dataFilename, ArchiveEntry &entry) {
+    auto archiveFilename = getArchiveFilename(fileInfo.archiveFileId, dataFilename);
+    if (archiveFilename.empty()) {
+        return false;
+    }
+
+    // The sizes in the file info tables are one more than the number of bytes stored.
+    size_t size = fileInfo.size > 0 ? fileInfo.size - 1 : 0;
+    if (!getEntry(archiveFilename, fileInfo.offset, size, entry)) {
+        std::cout << "Error: Entry 0x" << std::hex << fileInfo.id << std::dec << " lies outside " << archiveFilename << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool ArchiveSet::getEntry(const std::string &archiveFilename, size_t offset, size_t size, ArchiveEntry &entry) {
+    auto &archive = openArchive(archiveFilename);
+    if (offset > archive.getSize() || size > archive.getSize() - offset) {
+        return false;
+    }
+
+    entry.data = archive.getData() + offset;
+    entry.size = size;
+    entry.fd = archive.getFileDescriptor();
+    entry.offset = offset;
+    return true;
+}
+
+bool ArchiveSet::writeEntry(const ArchiveEntry &entry, const std::string &outFilename) {
+#ifdef TD3EXTRACT_USE_MMAP
+    int outFd = open(outFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (outFd == -1) {
+        return false;
+    }
+
+    /* Try copy_file_range() first as it can copy on the server or share extents. sendfile() still avoids
+     * a copy through user space. Either can stop early, e.g. when the files are on different file systems,
+     * in which case the rest is written straight from the archive mapping.
+     */
+    size_t written = 0;
+#ifdef __linux__
+    if (entry.fd != -1) {
+        loff_t copyOffset = (loff_t)entry.offset;
+        while (written < entry.size) {
+            ssize_t count = copy_file_range(entry.fd, &copyOffset, outFd, nullptr, entry.size - written, 0);
+            if (count <= 0) {
+                break;
+            }
+            written += count;
+        }
+
+        off_t sendOffset = (off_t)(entry.offset + written);
+        while (written < entry.size) {
+            ssize_t count = sendfile(outFd, entry.fd, &sendOffset, entry.size - written);
+            if (count <= 0) {
+                break;
+            }
+            written += count;
+        }
+    }
+#endif
+
+    while (written < entry.size) {
+        ssize_t count = write(outFd, entry.data + written, std::min(entry.size - written, ARCHIVE_WRITE_CHUNK_SIZE));
+        if (count <= 0) {
+            close(outFd);
+            return false;
+        }
+        written += count;
+    }
+    return close(outFd) == 0;
+#else
+    std::ofstream outFile(outFilename, std::ios::binary);
+    outFile.write(reinterpret_cast<const char *>(entry.data), (std::streamsize)entry.size);
+    outFile.close();
+    return outFile.good();
+#endif
+}
+
+const MappedFile &ArchiveSet::openArchive(const std::string &archiveFilename) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &archive = archives[archiveFilename];
+    if (!archive) {
+        archive = std::make_unique<MappedFile>();
+        if (!archive->open(archiveFilename)) {
+            std::cout << "Error: Failed to open " << archiveFilename << "\n";
+            exit(1);
+        }
+    }
+    return *archive;
+}
@@ -0,0 +1,82 @@
+/*
+MIT License
+
+Copyright (c) 2023 Eric Fry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef TD3EXTRACT_ARCHIVE_H
+#define TD3EXTRACT_ARCHIVE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "file.h"
+
+#pragma pack(push, 1)
+struct DataArchiveFileStruct {
+    unsigned int id;
+    short archiveFileId;
+    unsigned int offset;
+    unsigned int size;
+};
+#pragma pack(pop)
+
+// The stored bytes of an archive entry. Points into the archive mapping and stays valid for the life of the ArchiveSet.
+// The archive's file descriptor and offset are also kept so the entry can be copied without going through memory.
+struct ArchiveEntry {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    int fd = -1;
+    size_t offset = 0;
+};
+
+/* Opens each .DAT archive once and keeps it mapped into memory.
+ * Entries are handed out as views into the mapping so no data is copied. Safe to use from multiple threads.
+ */
+class ArchiveSet {
+private:
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<MappedFile>> archives;
+
+public:
+    ArchiveSet() = default;
+    ArchiveSet(const ArchiveSet &) = delete;
+    ArchiveSet &operator=(const ArchiveSet &) = delete;
+
+    // Archive ids 'd' and 'e' refer to the car or scene archive given by dataFilename.
+    static std::string getArchiveFilename(short archiveFileId, const std::string &dataFilename);
+
+    // Returns false if the entry's archive is unknown or the entry lies outside the archive.
+    bool getEntry(const DataArchiveFileStruct &fileInfo, const std::string &dataFilename, ArchiveEntry &entry);
+    // Looks up an entry by its location. Returns false if it lies outside the archive.
+    bool getEntry(const std::string &archiveFilename, size_t offset, size_t size, ArchiveEntry &entry);
+
+    // Writes the entry's bytes to a new file, letting the kernel do the copy where possible.
+    // Returns false if the file couldn't be created or fully written.
+    static bool writeEntry(const ArchiveEntry &entry, const std::string &outFilename);
+
+private:
+    const MappedFile &openArchive(const std::string &archiveFilename);
+};
+
+#endif //TD3EXTRACT_ARCHIVE_H
@@ -21,8 +21,18 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
+#include <algorithm>
 #include <iostream>
 #include "file.h"
+#include "rle.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TD3EXTRACT_USE_MMAP
+#endif
 
 std::ifstream openFileForRead(const std::string &file) {
     auto fp = std::ifstream(file, std::ios::binary);
@@ -49,27 +59,91 @@ int getFileSize(std::ifstream &file) {
     return size;
 }
 
+std::vector<uint8_t> loadFile(const std::string &file) {
+    auto fp = openFileForRead(file);
+    std::vector<uint8_t> buf(getFileSize(fp));
+    fp.read(reinterpret_cast<char *>(buf.data()), (std::streamsize)buf.size());
+    fp.close();
+    return buf;
+}
+
+MappedFile::~MappedFile() {
+#ifdef TD3EXTRACT_USE_MMAP
+    if (isMapped) {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+#endif
+}
+
+bool MappedFile::open(const std::string &file) {
+#ifdef TD3EXTRACT_USE_MMAP
+    int fileFd = ::open(file.c_str(), O_RDONLY);
+    if (fileFd == -1) {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fileFd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+        close(fileFd);
+        return false;
+    }
+    if (fileStat.st_size > 0) {
+        void *mappedData = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fileFd, 0);
+        if (mappedData != MAP_FAILED) {
+            data = static_cast<const uint8_t *>(mappedData);
+            size = (size_t)fileStat.st_size;
+            isMapped = true;
+            fd = fileFd;
+            return true;
+        }
+    }
+    close(fileFd);
+#endif
+
+    auto fp = std::ifstream(file, std::ios::binary);
+    if (!fp.is_open()) {
+        return false;
+    }
+    int fileSize = getFileSize(fp);
+    if (fileSize < 0) {
+        return false;
+    }
+    fileData.resize(fileSize);
+    if (!fp.read(reinterpret_cast<char *>(fileData.data()), (std::streamsize)fileData.size())) {
+        return false;
+    }
+    data = fileData.data();
+    size = fileData.size();
+    return true;
+}
+
+/* The packed file is read in one go and expanded a block at a time.
+ * Each block covers as many whole runs as fit in RLE_UNPACK_BLOCK_SIZE bytes of output.
+ */
 void unpackRLEImage(const std::string &srcFilename, const std::string &outFilename) {
-    auto srcFile = openFileForRead(srcFilename);
+    auto packedData = loadFile(srcFilename);
     auto outFile = openFileForWrite(outFilename);
 
-    int srcSize = getFileSize(srcFile);
-
-    for (int curPos = 0; curPos < srcSize; curPos += 2) {
-        char pixelValue;
-        uint8_t lengthByte;
-        srcFile.read(&pixelValue, 1);
+    size_t unpackedSize = getRLEUnpackedSize(packedData.data(), packedData.size());
+    if (unpackedSize == 0) {
+        outFile.close();
+        return;
+    }
+    std::vector<uint8_t> outBuf(std::min(unpackedSize, RLE_UNPACK_BLOCK_SIZE));
 
-        srcFile.read(reinterpret_cast<char *>(&lengthByte), 1);
-        if (lengthByte & 1) {
-            outFile.write(&pixelValue, 1);
-        }
-        lengthByte = lengthByte >> 1;
-        for (int i = 0; i < lengthByte; i++) {
-            outFile.write(&pixelValue, 1);
-            outFile.write(&pixelValue, 1);
+    size_t numPairs = packedData.size() / 2;
+    size_t blockStart = 0;
+    while (blockStart < numPairs) {
+        size_t blockEnd = blockStart;
+        size_t blockSize = 0;
+        for (; blockEnd < numPairs && blockSize + packedData[blockEnd * 2 + 1] <= outBuf.size(); blockEnd++) {
+            blockSize += packedData[blockEnd * 2 + 1];
         }
+        unpackRLEData(&packedData[blockStart * 2], (blockEnd - blockStart) * 2, outBuf.data());
+        outFile.write(reinterpret_cast<const char *>(outBuf.data()), (std::streamsize)blockSize);
+        blockStart = blockEnd;
     }
     outFile.close();
-    srcFile.close();
 }
@@ -24,12 +24,41 @@ SOFTWARE.
 #ifndef TD3EXTRACT_FILE_H
 #define TD3EXTRACT_FILE_H
 
+#include <cstdint>
 #include <fstream>
 #include <string>
+#include <vector>
 
 std::ifstream openFileForRead(const std::string &file);
 std::ofstream openFileForWrite(const std::string &file);
 int getFileSize(std::ifstream &file);
+std::vector<uint8_t> loadFile(const std::string &file);
+
+/* A read only view of a whole file. The file is memory mapped where possible and read into memory otherwise. */
+class MappedFile {
+private:
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    bool isMapped = false;
+    int fd = -1;
+    std::vector<uint8_t> fileData; // Used if the file couldn't be mapped.
+
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Returns false if the file can't be opened.
+    bool open(const std::string &file);
+    const uint8_t *getData() const { return data; }
+    size_t getSize() const { return size; }
+    // The open descriptor of a mapped file, or -1.
+    int getFileDescriptor() const { return fd; }
+};
+
+// Output is expanded and written in blocks of this many bytes.
+constexpr size_t RLE_UNPACK_BLOCK_SIZE = 0x100000;
 
 void unpackRLEImage(const std::string &srcFilename, const std::string &outFilename);
 
@@ -21,29 +21,28 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include "image.h"
 #include "lzw.h"
 #include "file.h"
 #include "lodepng.h"
+#include "palette.h"
+#include "rle.h"
 
 bool Image::loadTD3LZImageFile(const std::string &srcFilename, int imageWidth, const std::string &srcPaletteFilename) {
     width = imageWidth;
-    delete pixels;
-    pixels = nullptr;
+    pixels.reset();
+    bottomUp = false;
 
     LZWDecoder lzwDecoder;
     auto decodedBuffer = lzwDecoder.decode(srcFilename);
-    auto unpackedPixels = unpackRLE(decodedBuffer);
-
-    height = unpackedPixels.size() / width;
-    if (unpackedPixels.size() % width != 0) {
-        std::cout << "Error: insufficient image data for specified width: " << width << "\n\n";
-        exit(1);
+    if (!unpackRLE(decodedBuffer)) {
+        return false;
     }
 
-    generatePixelBufFromUnpackedRLEData(unpackedPixels);
-
     loadPalette(srcPaletteFilename);
 
     return true;
@@ -68,11 +67,20 @@ bool Image::loadPngFile(const std::string &srcFilename) {
     state.info_raw.colortype = LCT_PALETTE;
     state.info_raw.bitdepth = 8;
 
-    error = lodepng_decode(&pixels, &width, &height, &state, &png[0], png.size());
+    bottomUp = false;
+    pixels.reset();
+    uint8_t *decodedPixels = nullptr;
+    error = lodepng_decode(&decodedPixels, &width, &height, &state, &png[0], png.size());
     if (error) {
+        free(decodedPixels);
         std::cout << "[read_png_file] decoder error " << error << ": "<< lodepng_error_text(error) << std::endl;
         return false;
     }
+    // lodepng allocates with malloc(). Copy the pixels into our own buffer so they're always released with delete[].
+    size_t numPixels = (size_t)width * height;
+    pixels.reset(new uint8_t [numPixels]);
+    memcpy(pixels.get(), decodedPixels, numPixels);
+    free(decodedPixels);
     return false;
 }
 
@@ -84,26 +92,14 @@ bool Image::savePngFile(const std::string &pngFilename) {
     state.info_png.color.colortype = LCT_PALETTE;
     state.info_png.color.bitdepth = 8;
     state.encoder.auto_convert = false;
+    setRowOrder(false);
 
-
-    for (int i = 0; i < palette.size(); i += 3) {
-        // copy the palette into src + dest info. This preserves the palette. Other wise it strips unused colours on save.
-        lodepng_palette_add(
-                &state.info_raw,
-                palette[i],
-                palette[i+1],
-                palette[i+2],
-                0xFF
-        );
-        lodepng_palette_add(
-                &state.info_png.color,
-                palette[i],
-                palette[i+1],
-                palette[i+2],
-                0xFF
-        );
+    // Copy the whole palette into src + dest info. Otherwise unused colours are stripped on save.
+    if (palette) {
+        lodepng_color_mode_copy(&state.info_raw, &palette->getColorMode());
+        lodepng_color_mode_copy(&state.info_png.color, &palette->getColorMode());
     }
-    unsigned error = lodepng::encode(png, pixels, (unsigned int)width, (unsigned int)height, state);
+    unsigned error = lodepng::encode(png, pixels.get(), (unsigned int)width, (unsigned int)height, state);
     if(!error) lodepng::save_file(png, pngFilename);
     if (error) {
         std::cout << "[savePngFile] encoder error " << error << ": "<< lodepng_error_text(error) << std::endl;
@@ -113,102 +109,93 @@ bool Image::savePngFile(const std::string &pngFilename) {
     return true;
 }
 
-std::vector<uint8_t> Image::unpackRLE(std::vector<uint8_t> packedData) {
-    std::vector<uint8_t> outBuffer;
-    for (int curPos = 0; curPos < packedData.size(); curPos += 2) {
-        uint8_t pixelValue = packedData[curPos];
-        uint8_t lengthByte = packedData[curPos + 1];
+/* Expands the (pixel, length) pairs straight into the pixel buffer.
+ * The packed rows are stored bottom up so each row is written directly into its flipped position.
+ * Returns false if the data isn't a whole number of rows.
+ */
+bool Image::unpackRLE(const std::vector<uint8_t> &packedData) {
+    size_t numPixels = getRLEUnpackedSize(packedData.data(), packedData.size());
 
-        if (lengthByte & 1) {
-            outBuffer.emplace_back(pixelValue);
-        }
-        lengthByte = lengthByte >> 1;
-        for (int i = 0; i < lengthByte; i++) {
-            outBuffer.emplace_back(pixelValue);
-            outBuffer.emplace_back(pixelValue);
-        }
+    if (width == 0 || numPixels % width != 0) {
+        return false;
     }
-    return outBuffer;
-}
-
-void Image::generatePixelBufFromUnpackedRLEData(const std::vector<uint8_t> &unpackedPixels) {
-    pixels = new uint8_t [unpackedPixels.size()];
+    height = numPixels / width;
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            pixels[(height - 1 - y) * width + x] = unpackedPixels[y * width + x];
-        }
+    pixels.reset(new uint8_t [numPixels]);
+    if (height > 0) {
+        unpackRLERows(packedData.data(), packedData.size(), &pixels[(height - 1) * width], width, -(ptrdiff_t)width);
     }
+    return true;
 }
 
-const static uint8_t basePal[48] = {
-        0x00, 0x00, 0x00,
-        0x00, 0x00, 0x28,
-        0x00, 0x28, 0x00,
-        0x00, 0x28, 0x28,
-        0x28, 0x00, 0x00,
-        0x28, 0x00, 0x28,
-        0x28, 0x14, 0x00,
-        0x28, 0x28, 0x28,
-        0x14, 0x14, 0x14,
-        0x14, 0x14, 0x3c,
-        0x14, 0x3c, 0x14,
-        0x14, 0x3c, 0x3c,
-        0x3c, 0x14, 0x14,
-        0x3c, 0x14, 0x3c,
-        0x3c, 0x3c, 0x14,
-        0x3c, 0x3c, 0x3c
-};
-
 void Image::loadPalette(const std::string &srcPaletteFilename) {
-    palette.clear();
-    palette.reserve(256 * 3);
-    auto srcFile = openFileForRead(srcPaletteFilename);
-
-    for (auto c : basePal) {
-        c = c << 2;
-        palette.emplace_back(c);
-    }
-
-    for (int i = 0; i < 336; i++) {
-        uint8_t c;
-        srcFile.read(reinterpret_cast<char *>(&c), 1);
-        c = c << 2;
-        palette.emplace_back(c);
-    }
-    srcFile.close();
+    palette = PaletteCache::load(srcPaletteFilename);
 }
 
-bool Image::saveLZWFile(const std::string &outFilename) {
-    auto flippedPixels = formatPixelsForRLE();
-    auto rlePixels = packRLE(flippedPixels);
+bool Image::saveLZWFile(const std::string &outFilename, ThreadPool *threadPool, int compressionLevel, bool optimizeRLE) {
+    setRowOrder(true);
+    size_t numPixels = (size_t)width * height;
 
     LZWEncoder lzwEncoder;
-    lzwEncoder.encode(rlePixels, outFilename);
+    lzwEncoder.setCompressionLevel(compressionLevel);
+
+    /* Plain maximal runs are best for RLE alone, but the LZW stage does better when repeated rows give
+     * repeated byte patterns. When optimising, try each way of splitting the runs and keep the one with
+     * the smallest LZW output. Every variant unpacks to exactly the same pixels.
+     */
+    std::vector<uint8_t> bestLzw;
+    int numSplitModes = optimizeRLE ? 4 : 1;
+    for (int splitMode = 0; splitMode < numSplitModes; splitMode++) {
+        auto rlePixels = packRLE(pixels.get(), numPixels, (splitMode & 1) != 0, (splitMode & 2) != 0);
+        auto &lzw = threadPool ? lzwEncoder.encode(rlePixels.data(), rlePixels.size(), *threadPool)
+                               : lzwEncoder.encode(rlePixels.data(), rlePixels.size());
+        if (splitMode == 0 || lzw.size() < bestLzw.size()) {
+            bestLzw = lzw;
+        }
+    }
+
+    auto outFile = openFileForWrite(outFilename);
+    outFile.write(reinterpret_cast<const char *>(bestLzw.data()), (std::streamsize)bestLzw.size());
+    outFile.close();
     return true;
 }
 
-std::vector<uint8_t> Image::packRLE(std::vector<uint8_t> &unpackedData) {
+/* Packs pixels into (pixel, length) pairs with runs of up to 255 pixels.
+ * splitAtRowEnds stops runs crossing from one row to the next, so identical rows pack to identical bytes.
+ * balanceLongRuns splits runs longer than 255 into equal parts rather than 255s and a remainder.
+ */
+std::vector<uint8_t> Image::packRLE(const uint8_t *unpackedData, size_t size, bool splitAtRowEnds, bool balanceLongRuns) {
     std::vector<uint8_t> rleData;
-    for (int curPos = 0; curPos < unpackedData.size(); ) {
+    for (size_t curPos = 0; curPos < size; ) {
         auto pixel = unpackedData[curPos];
-        curPos++;
-        int runLength = 1;
-        for(; curPos < unpackedData.size() && unpackedData[curPos] == pixel && runLength < 255; curPos++) {
-            runLength++;
+        size_t maxRunEnd = size;
+        if (splitAtRowEnds) {
+            maxRunEnd = std::min(maxRunEnd, (curPos / width + 1) * width);
+        }
+        if (!balanceLongRuns) {
+            maxRunEnd = std::min(maxRunEnd, curPos + 255);
+        }
+        size_t runEnd = findRunEnd(unpackedData, curPos, maxRunEnd);
+
+        size_t runLength = runEnd - curPos;
+        size_t numParts = (runLength + 254) / 255;
+        for (size_t part = 0; part < numParts; part++) {
+            rleData.emplace_back(pixel);
+            rleData.emplace_back(runLength / numParts + (part < runLength % numParts ? 1 : 0));
         }
-        rleData.emplace_back(pixel);
-        rleData.emplace_back(runLength);
+        curPos = runEnd;
     }
     return rleData;
 }
 
-std::vector<uint8_t> Image::formatPixelsForRLE() {
-    std::vector<uint8_t> flippedRows;
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            flippedRows.emplace_back(pixels[(height - 1 - y) * width + x]);
-        }
+// Flips the image vertically in place by swapping rows, if it isn't already in the requested order.
+void Image::setRowOrder(bool storeBottomUp) {
+    if (storeBottomUp == bottomUp) {
+        return;
+    }
+    for (unsigned int y = 0; y < height / 2; y++) {
+        uint8_t *topRow = &pixels[y * width];
+        std::swap_ranges(topRow, topRow + width, &pixels[(height - 1 - y) * width]);
     }
-    return flippedRows;
+    bottomUp = storeBottomUp;
 }
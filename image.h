@@ -25,28 +25,37 @@ SOFTWARE.
 #ifndef TD3EXTRACT_IMAGE_H
 #define TD3EXTRACT_IMAGE_H
 
+#include <memory>
 #include <string>
 #include <vector>
 
+class ThreadPool;
+class Palette;
+
 class Image {
 private:
     unsigned int width = 0;
     unsigned int height = 0;
-    std::vector<uint8_t> palette;
-    uint8_t *pixels = nullptr;
+    std::shared_ptr<const Palette> palette;
+    std::unique_ptr<uint8_t[]> pixels;
+    // The game stores rows bottom up. Pixels are kept in whichever order the last user needed.
+    bool bottomUp = false;
 
 public:
+    Image() = default;
+    Image(const Image &) = delete;
+    Image &operator=(const Image &) = delete;
+
     bool loadTD3LZImageFile(const std::string &srcFilename, int imageWidth, const std::string &srcPaletteFilename);
     bool loadPngFile(const std::string &srcFilename);
     bool savePngFile(const std::string &pngFilename);
-    bool saveLZWFile(const std::string &outFilename);
+    bool saveLZWFile(const std::string &outFilename, ThreadPool *threadPool = nullptr, int compressionLevel = 1, bool optimizeRLE = false);
 
 private:
     void loadPalette(const std::string &srcPaletteFilename);
-    std::vector<uint8_t> unpackRLE(std::vector<uint8_t> packedData);
-    void generatePixelBufFromUnpackedRLEData(const std::vector<uint8_t> &unpackedPixels);
+    bool unpackRLE(const std::vector<uint8_t> &packedData);
 
-    std::vector<uint8_t> formatPixelsForRLE();
-    std::vector<uint8_t> packRLE(std::vector<uint8_t> &unpackedData);
+    void setRowOrder(bool storeBottomUp);
+    std::vector<uint8_t> packRLE(const uint8_t *unpackedData, size_t size, bool splitAtRowEnds, bool balanceLongRuns);
 };
 #endif //TD3EXTRACT_IMAGE_H
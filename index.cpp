@@ -0,0 +1,143 @@
+/*
+MIT License
+
+Copyright (c) 2023 Eric Fry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include "index.h"
+
+bool ArchiveIndex::load(const std::string &indexFilename) {
+    if (!file.open(indexFilename) || file.getSize() < sizeof(ArchiveIndexHeader)) {
+        return false;
+    }
+    auto data = file.getData();
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != ARCHIVE_INDEX_MAGIC || header.version != ARCHIVE_INDEX_VERSION) {
+        return false;
+    }
+
+    uint64_t sourcesSize = (uint64_t)header.numSources * sizeof(ArchiveIndexSource);
+    uint64_t recordsSize = (uint64_t)header.numEntries * sizeof(ArchiveIndexRecord);
+    if (sizeof(header) + sourcesSize + recordsSize + header.stringTableSize != file.getSize()
+        || header.stringTableSize == 0 || data[file.getSize() - 1] != 0) {
+        return false;
+    }
+    auto sources = data + sizeof(header);
+    records = sources + sourcesSize;
+    stringTable = reinterpret_cast<const char *>(records + recordsSize);
+
+    for (uint32_t i = 0; i < header.numSources; i++) {
+        ArchiveIndexSource source;
+        memcpy(&source, sources + i * sizeof(source), sizeof(source));
+        int64_t modifiedTime;
+        uint64_t size;
+        if (source.filenameOffset >= header.stringTableSize
+            || !getSourceInfo(&stringTable[source.filenameOffset], modifiedTime, size)
+            || modifiedTime != source.modifiedTime || size != source.size) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header.numEntries; i++) {
+        ArchiveIndexRecord record;
+        memcpy(&record, records + i * sizeof(record), sizeof(record));
+        if (record.archiveFilenameOffset >= header.stringTableSize || record.filenameOffset >= header.stringTableSize) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ArchiveIndexEntry ArchiveIndex::getEntry(size_t i) const {
+    ArchiveIndexRecord record;
+    memcpy(&record, records + i * sizeof(record), sizeof(record));
+    return {&stringTable[record.archiveFilenameOffset], &stringTable[record.filenameOffset], record.offset, record.size, record.contentHash};
+}
+
+bool ArchiveIndex::save(const std::string &indexFilename, const std::vector<std::string> &sourceFilenames, const std::vector<ArchiveIndexEntry> &entries) {
+    std::vector<char> stringTable;
+    auto addString = [&](const std::string &s) {
+        auto offset = (uint32_t)stringTable.size();
+        stringTable.insert(stringTable.end(), s.c_str(), s.c_str() + s.size() + 1);
+        return offset;
+    };
+
+    std::vector<ArchiveIndexSource> sources;
+    for (auto &filename : sourceFilenames) {
+        ArchiveIndexSource source = {addString(filename), 0, 0};
+        if (!getSourceInfo(filename, source.modifiedTime, source.size)) {
+            return false;
+        }
+        sources.emplace_back(source);
+    }
+
+    std::vector<ArchiveIndexRecord> records;
+    for (auto &entry : entries) {
+        records.push_back({addString(entry.archiveFilename), addString(entry.filename), entry.offset, entry.size, entry.contentHash});
+    }
+
+    ArchiveIndexHeader header = {ARCHIVE_INDEX_MAGIC, ARCHIVE_INDEX_VERSION, (uint32_t)sources.size(), (uint32_t)records.size(), (uint32_t)stringTable.size()};
+
+    // Written to a temporary file first so a partly written index is never picked up.
+    auto tempFilename = indexFilename + ".tmp";
+    std::error_code error;
+    std::ofstream outFile(tempFilename, std::ios::binary);
+    if (outFile.is_open()) {
+        outFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        outFile.write(reinterpret_cast<const char *>(sources.data()), (std::streamsize)(sources.size() * sizeof(ArchiveIndexSource)));
+        outFile.write(reinterpret_cast<const char *>(records.data()), (std::streamsize)(records.size() * sizeof(ArchiveIndexRecord)));
+        outFile.write(stringTable.data(), (std::streamsize)stringTable.size());
+        outFile.close();
+        if (outFile.good()) {
+            std::filesystem::rename(tempFilename, indexFilename, error);
+            if (!error) {
+                return true;
+            }
+        }
+    }
+
+    std::filesystem::remove(tempFilename, error);
+    return false;
+}
+
+// 64-bit FNV-1a
+uint64_t ArchiveIndex::hashContent(const uint8_t *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+bool ArchiveIndex::getSourceInfo(const std::string &filename, int64_t &modifiedTime, uint64_t &size) {
+    std::error_code error;
+    auto time = std::filesystem::last_write_time(filename, error);
+    if (error) {
+        return false;
+    }
+    size = std::filesystem::file_size(filename, error);
+    if (error) {
+        return false;
+    }
+    modifiedTime = (int64_t)time.time_since_epoch().count();
+    return true;
+}
@@ -0,0 +1,96 @@
+/*
+MIT License
+
+Copyright (c) 2023 Eric Fry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef TD3EXTRACT_INDEX_H
+#define TD3EXTRACT_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "file.h"
+
+/* td3.idx layout. All values are little endian.
+ *   ArchiveIndexHeader
+ *   ArchiveIndexSource[numSources]  Files the index was built from.
+ *   ArchiveIndexRecord[numEntries]  One per extracted file, in extraction order.
+ *   char[stringTableSize]           NUL terminated strings referenced by offset.
+ */
+constexpr uint32_t ARCHIVE_INDEX_MAGIC = 0x49334454; // "TD3I"
+constexpr uint32_t ARCHIVE_INDEX_VERSION = 1;
+
+#pragma pack(push, 1)
+struct ArchiveIndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numSources;
+    uint32_t numEntries;
+    uint32_t stringTableSize;
+};
+
+struct ArchiveIndexSource {
+    uint32_t filenameOffset;
+    int64_t modifiedTime;
+    uint64_t size;
+};
+
+struct ArchiveIndexRecord {
+    uint32_t archiveFilenameOffset;
+    uint32_t filenameOffset;
+    uint32_t offset;
+    uint32_t size;
+    uint64_t contentHash;
+};
+#pragma pack(pop)
+
+struct ArchiveIndexEntry {
+    std::string archiveFilename;
+    std::string filename;
+    uint32_t offset;
+    uint32_t size;
+    uint64_t contentHash;
+};
+
+/* A catalogue of every file in the game archives so later runs can skip scanning TD3.EXE and the .LST files.
+ * The index is rebuilt whenever one of the files it was built from changes.
+ */
+class ArchiveIndex {
+private:
+    MappedFile file;
+    ArchiveIndexHeader header = {};
+    const uint8_t *records = nullptr;
+    const char *stringTable = nullptr;
+
+public:
+    // Returns false if the index is missing, invalid or out of date.
+    bool load(const std::string &indexFilename);
+    size_t getNumEntries() const { return header.numEntries; }
+    ArchiveIndexEntry getEntry(size_t i) const;
+
+    static bool save(const std::string &indexFilename, const std::vector<std::string> &sourceFilenames, const std::vector<ArchiveIndexEntry> &entries);
+    static uint64_t hashContent(const uint8_t *data, size_t size);
+
+private:
+    static bool getSourceInfo(const std::string &filename, int64_t &modifiedTime, uint64_t &size);
+};
+
+#endif //TD3EXTRACT_INDEX_H
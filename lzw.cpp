@@ -21,175 +21,645 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include "lzw.h"
 #include "file.h"
-
-LZWDecoder::LZWDecoder() = default;
+#include "threadpool.h"
 
 constexpr int END_OF_STREAM_MARKER = 0x101;
 constexpr int RESET_DICTIONARY_MARKER = 0x100;
 constexpr int MAX_CODE_ID_BIT_LENGTH = 12;
 
-std::vector<uint8_t> LZWDecoder::decode(const std::string &srcFilename) {
-    resetState();
-    decodedBuffer.clear();
-    srcFile = openFileForRead(srcFilename);
-    inputSize = getFileSize(srcFile);
-    inputBuf = new unsigned char [inputSize];
-    srcFile.read((char *)inputBuf, inputSize);
-    curBitPosition = 0;
-
-    int nextCodeId;
-    while (nextCodeId = getNextCodeFromInput(), nextCodeId != END_OF_STREAM_MARKER) {
-        if (nextCodeId == RESET_DICTIONARY_MARKER) {
-            resetState();
-            nextCodeId = getNextCodeFromInput();
-            Sequence newSequence = {(uint8_t)nextCodeId};
-            writeSequenceToFile(newSequence);
-            previousEmittedSequence = newSequence;
-        } else {
-            if(isCodeIdInDictionary(nextCodeId)) {
-                auto sequence = dictionary[nextCodeId];
-                writeSequenceToFile(sequence);
-                Sequence newSequence = previousEmittedSequence;
-                newSequence.emplace_back(sequence[0]);
-                addSequenceToDictionary(newSequence);
-                previousEmittedSequence = sequence;
-            } else {
-                if (!previousEmittedSequence.empty()) {
-                    Sequence newSequence = previousEmittedSequence;
-                    newSequence.emplace_back(previousEmittedSequence[0]);
-                    addSequenceToDictionary(newSequence);
-                    writeSequenceToFile(newSequence);
-                    previousEmittedSequence = newSequence;
-                }
+void LZWBitReader::reset(const uint8_t *buf, size_t size) {
+    inputBuf = buf;
+    inputSize = size;
+    bytePosition = 0;
+    bitBuffer = 0;
+    bitCount = 0;
+}
+
+inline void LZWBitReader::refill() {
+    if (bytePosition + 8 <= inputSize) {
+        // Bits above bitCount already hold the same stream bits so they can safely be OR'd again.
+        uint64_t word;
+        memcpy(&word, inputBuf + bytePosition, 8);
+        bitBuffer |= word << bitCount;
+        bytePosition += (63 - bitCount) >> 3;
+        bitCount |= 56;
+    } else {
+        // Near the end of the buffer load a byte at a time, padding with zeros.
+        for (; bitCount <= 56; bitCount += 8, bytePosition++) {
+            if (bytePosition < inputSize) {
+                bitBuffer |= (uint64_t)inputBuf[bytePosition] << bitCount;
             }
         }
     }
-
-    delete inputBuf;
-    srcFile.close();
-    return decodedBuffer;
 }
 
-bool LZWDecoder::decode(const std::string &srcFilename, const std::string &outFilename) {
-    auto outFile = openFileForWrite(outFilename);
-
-    decode(srcFilename);
-
-    for (int i = 0; i < decodedBuffer.size(); i++) {
-        uint8_t value = decodedBuffer[i];
-        outFile.write(reinterpret_cast<const char *>(&value), 1);
+inline int LZWBitReader::readCode(int bitLength) {
+    if (bitCount < bitLength) {
+        refill();
     }
+    int codeId = (int)(bitBuffer & ((1u << bitLength) - 1));
+    bitBuffer >>= bitLength;
+    bitCount -= bitLength;
+    return codeId;
+}
 
-    return true;
+inline bool LZWBitReader::hasBits(int bitLength) const {
+    return bytePosition * 8 - bitCount + bitLength <= inputSize * 8;
 }
 
-void LZWDecoder::resetState() {
-    dictionary.clear();
+LZWDictionary::LZWDictionary() {
     for (int i = 0; i < 256; i++) {
-        dictionary[i] = {(uint8_t)i};
+        dictionary[i] = {0, 1, (uint8_t)i, (uint8_t)i};
     }
+}
+
+void LZWDictionary::resetState() {
+    // The single byte entries 0 - 255 never change so only the counters need resetting.
     nextAvailableCodeId = 0x102;
     currentCodeIdBitLength = 9;
     codeIdBitLengthChange = 0x200;
-    previousEmittedSequence.clear();
+    previousEmittedCodeId = -1;
+    expectingLiteral = false;
 }
 
-static const unsigned short lzwCodeIdBitMaskTbl[] = {0x1ff, 0x3ff, 0x7ff, 0xfff};
+bool LZWDictionary::isEndOfStream(int codeId) const {
+    return codeId == END_OF_STREAM_MARKER && !expectingLiteral;
+}
 
-int LZWDecoder::getNextCodeFromInput() {
-    int byteOffset = curBitPosition / 8;
-    int byteRemainder = curBitPosition % 8;
-    curBitPosition += currentCodeIdBitLength;
+bool LZWDictionary::isResetMarker(int codeId) const {
+    return codeId == RESET_DICTIONARY_MARKER && !expectingLiteral;
+}
 
-    unsigned short word = inputBuf[byteOffset] + ((unsigned short)inputBuf[byteOffset + 1] << 8);
-    unsigned char byte = inputBuf[byteOffset + 2];
+int LZWDictionary::processCode(int codeId) {
+    if (expectingLiteral) {
+        // The code following a reset is always a single byte.
+        expectingLiteral = false;
+        previousEmittedCodeId = codeId & 0xff;
+        return previousEmittedCodeId;
+    }
 
-    for(; byteRemainder != 0; byteRemainder--) {
-        word = word >> 1 | (unsigned short)(byte & 1) << 0xf;
-        byte = byte >> 1;
+    if (codeId == RESET_DICTIONARY_MARKER) {
+        resetState();
+        expectingLiteral = true;
+        return -1;
     }
-    int codeId = word & lzwCodeIdBitMaskTbl[currentCodeIdBitLength - 9];
-//    printf("codeId: %d bitlength: %d\n", codeId, currentCodeIdBitLength);
-    return codeId;
+
+    if (isCodeIdInDictionary(codeId)) {
+        addSequenceToDictionary(previousEmittedCodeId, dictionary[codeId].firstByte);
+        previousEmittedCodeId = codeId;
+        return codeId;
+    }
+
+    if (previousEmittedCodeId != -1) {
+        previousEmittedCodeId = addSequenceToDictionary(previousEmittedCodeId, dictionary[previousEmittedCodeId].firstByte);
+        return previousEmittedCodeId;
+    }
+
+    return -1;
 }
 
-bool LZWDecoder::isCodeIdInDictionary(int codeId) {
-    return dictionary.find(codeId) != dictionary.end();
+bool LZWDictionary::isCodeIdInDictionary(int codeId) const {
+    return codeId < 0x100 || (codeId >= 0x102 && codeId < nextAvailableCodeId);
 }
 
-void LZWDecoder::writeSequenceToFile(Sequence &sequence) {
-    for (auto &value : sequence) {
-        decodedBuffer.emplace_back(value);
-//        outFile.write(reinterpret_cast<const char *>(&value), 1);
+void LZWDictionary::writeSequence(int codeId, uint8_t *out, int offset, int count) const {
+    // Skip any trailing bytes that aren't wanted then walk the prefix links from the last byte back to the first.
+    for (int i = dictionary[codeId].length; i > offset + count; i--) {
+        codeId = dictionary[codeId].prefixCodeId;
+    }
+    out += count;
+    for (int i = 0; i < count; i++) {
+        *--out = dictionary[codeId].lastByte;
+        codeId = dictionary[codeId].prefixCodeId;
     }
 }
 
-void LZWDecoder::addSequenceToDictionary(Sequence &sequence) {
-    dictionary[nextAvailableCodeId] = sequence;
+int LZWDictionary::addSequenceToDictionary(int prefixCodeId, uint8_t byte) {
+    int codeId = nextAvailableCodeId;
+    if (codeId < LZW_MAX_DICTIONARY_SIZE) {
+        if (prefixCodeId == -1) {
+            dictionary[codeId] = {0, 1, byte, byte};
+        } else {
+            auto &prefix = dictionary[prefixCodeId];
+            dictionary[codeId] = {(uint16_t)prefixCodeId, (uint16_t)(prefix.length + 1), prefix.firstByte, byte};
+        }
+    }
     nextAvailableCodeId++;
     if(nextAvailableCodeId >= codeIdBitLengthChange && currentCodeIdBitLength != MAX_CODE_ID_BIT_LENGTH) {
         currentCodeIdBitLength++;
         codeIdBitLengthChange = codeIdBitLengthChange << 1;
     }
+    return codeId;
 }
 
+/* Runs the decoder over the code stream, or just one segment of it.
+ * With WriteOutput false only the entry lengths are used, giving the exact decoded size without
+ * producing any bytes. With WriteOutput true at most outSize bytes are written to outBuf.
+ * Either way the full decoded size is returned.
+ * A truncated stream is treated as if it ended with END_OF_STREAM_MARKER.
+ */
+template <bool WriteOutput>
+size_t LZWDecoder::decodeCodes(const uint8_t *src, size_t srcSize, const LZWSegment &segment, uint8_t *outBuf, size_t outSize) {
+    dictionary.resetState();
+    size_t startByte = segment.bitPosition / 8;
+    bitReader.reset(src + startByte, srcSize - startByte);
+    if (segment.bitPosition % 8 != 0) {
+        bitReader.readCode((int)(segment.bitPosition % 8));
+    }
+    if (segment.startsAfterReset) {
+        dictionary.processCode(RESET_DICTIONARY_MARKER);
+    }
+    size_t outPosition = 0;
 
-void LZWEncoder::encode(const std::vector<uint8_t> &data, const std::string &outFilename) {
+    while (bitReader.hasBits(dictionary.getCodeIdBitLength())) {
+        int nextCodeId = bitReader.readCode(dictionary.getCodeIdBitLength());
+        if (dictionary.isEndOfStream(nextCodeId) || (segment.endsAtReset && dictionary.isResetMarker(nextCodeId))) {
+            break;
+        }
+        int emitCodeId = dictionary.processCode(nextCodeId);
+        if (emitCodeId == -1) {
+            continue;
+        }
+
+        int length = dictionary.getSequenceLength(emitCodeId);
+        if constexpr (WriteOutput) {
+            if (outPosition + length <= outSize) {
+                dictionary.writeSequence(emitCodeId, outBuf + outPosition, 0, length);
+            } else if (outPosition < outSize) {
+                dictionary.writeSequence(emitCodeId, outBuf + outPosition, 0, (int)(outSize - outPosition));
+            }
+        }
+        outPosition += length;
+    }
+
+    return outPosition;
+}
+
+size_t LZWDecoder::decodedSize(const uint8_t *src, size_t srcSize) {
+    return decodeCodes<false>(src, srcSize, LZWSegment(), nullptr, 0);
+}
+
+size_t LZWDecoder::decodedSize(const std::string &srcFilename) {
+    auto inputBuf = loadFile(srcFilename);
+    return decodedSize(inputBuf.data(), inputBuf.size());
+}
+
+size_t LZWDecoder::decode(const uint8_t *src, size_t srcSize, uint8_t *outBuf, size_t outSize) {
+    return decodeCodes<true>(src, srcSize, LZWSegment(), outBuf, outSize);
+}
+
+std::vector<uint8_t> LZWDecoder::decode(const std::string &srcFilename) {
+    auto inputBuf = loadFile(srcFilename);
+    std::vector<uint8_t> decodedBuffer(decodedSize(inputBuf.data(), inputBuf.size()));
+    decode(inputBuf.data(), inputBuf.size(), decodedBuffer.data(), decodedBuffer.size());
+    return decodedBuffer;
+}
+
+bool LZWDecoder::decode(const std::string &srcFilename, const std::string &outFilename) {
+    auto srcFile = openFileForRead(srcFilename);
     auto outFile = openFileForWrite(outFilename);
 
-    auto lzw = encode(data);
+    // Stream the file through in fixed size chunks so memory use doesn't depend on the file size.
+    std::vector<char> inChunk(0x10000);
+    std::vector<uint8_t> outChunk(0x10000);
+    LZWStreamDecoder streamDecoder;
+    while (!streamDecoder.isFinished()) {
+        if (streamDecoder.needsInput()) {
+            srcFile.read(inChunk.data(), (std::streamsize)inChunk.size());
+            streamDecoder.feed(reinterpret_cast<const uint8_t *>(inChunk.data()), srcFile.gcount());
+            if (!srcFile) {
+                streamDecoder.endInput();
+            }
+        }
+        size_t count = streamDecoder.read(outChunk.data(), outChunk.size());
+        outFile.write(reinterpret_cast<const char *>(outChunk.data()), (std::streamsize)count);
+    }
+
+    return true;
+}
+
+/* Splits the stream at each RESET_DICTIONARY_MARKER and works out where each segment's output goes.
+ * The code width only depends on how many entries have been added since the last reset, so the
+ * reset markers can be found by counting codes without building the dictionary. The decoded size
+ * of each segment is then measured in parallel.
+ */
+std::vector<LZWSegment> LZWDecoder::findSegments(const uint8_t *src, size_t srcSize, ThreadPool &threadPool) {
+    std::vector<LZWSegment> segments(1);
+    segments[0].endsAtReset = true;
+
+    LZWBitReader bitReader;
+    bitReader.reset(src, srcSize);
+    size_t bitPosition = 0;
+    int nextAvailableCodeId = 0x102;
+    int currentCodeIdBitLength = 9;
+    int codeIdBitLengthChange = 0x200;
+    bool havePreviousCode = false;
+    bool expectingLiteral = false;
+
+    while (bitReader.hasBits(currentCodeIdBitLength)) {
+        int codeId = bitReader.readCode(currentCodeIdBitLength);
+        bitPosition += currentCodeIdBitLength;
+        if (expectingLiteral) {
+            expectingLiteral = false;
+            havePreviousCode = true;
+            continue;
+        }
+        if (codeId == END_OF_STREAM_MARKER) {
+            break;
+        }
+        if (codeId == RESET_DICTIONARY_MARKER) {
+            LZWSegment segment;
+            segment.bitPosition = bitPosition;
+            segment.startsAfterReset = true;
+            segment.endsAtReset = true;
+            segments.push_back(segment);
+            nextAvailableCodeId = 0x102;
+            currentCodeIdBitLength = 9;
+            codeIdBitLengthChange = 0x200;
+            havePreviousCode = false;
+            expectingLiteral = true;
+            continue;
+        }
+
+        // Every code adds an entry except an unknown code with nothing emitted before it.
+        bool isCodeIdInDictionary = codeId < 0x100 || (codeId >= 0x102 && codeId < nextAvailableCodeId);
+        if (!havePreviousCode && !isCodeIdInDictionary) {
+            continue;
+        }
+        havePreviousCode = true;
+        nextAvailableCodeId++;
+        if (nextAvailableCodeId >= codeIdBitLengthChange && currentCodeIdBitLength != MAX_CODE_ID_BIT_LENGTH) {
+            currentCodeIdBitLength++;
+            codeIdBitLengthChange = codeIdBitLengthChange << 1;
+        }
+    }
+
+    threadPool.parallelFor(segments.size(), [&](size_t i) {
+        LZWDecoder decoder;
+        segments[i].outSize = decoder.decodeCodes<false>(src, srcSize, segments[i], nullptr, 0);
+    });
 
-    for (int i = 0; i < lzw.size(); i++) {
-        uint8_t value = lzw[i];
-        outFile.write(reinterpret_cast<const char *>(&value), 1);
+    for (size_t i = 1; i < segments.size(); i++) {
+        segments[i].outPosition = segments[i - 1].outPosition + segments[i - 1].outSize;
     }
+    return segments;
+}
+
+void LZWDecoder::decodeSegments(const uint8_t *src, size_t srcSize, const std::vector<LZWSegment> &segments, uint8_t *outBuf, size_t outSize, ThreadPool &threadPool) {
+    threadPool.parallelFor(segments.size(), [&](size_t i) {
+        auto &segment = segments[i];
+        if (segment.outPosition < outSize) {
+            LZWDecoder decoder;
+            decoder.decodeCodes<true>(src, srcSize, segment, outBuf + segment.outPosition, std::min(segment.outSize, outSize - segment.outPosition));
+        }
+    });
+}
+
+size_t LZWDecoder::decode(const uint8_t *src, size_t srcSize, uint8_t *outBuf, size_t outSize, ThreadPool &threadPool) {
+    auto segments = findSegments(src, srcSize, threadPool);
+    decodeSegments(src, srcSize, segments, outBuf, outSize, threadPool);
+    return segments.back().outPosition + segments.back().outSize;
+}
+
+std::vector<uint8_t> LZWDecoder::decode(const std::string &srcFilename, ThreadPool &threadPool) {
+    auto inputBuf = loadFile(srcFilename);
+    auto segments = findSegments(inputBuf.data(), inputBuf.size(), threadPool);
+    std::vector<uint8_t> decodedBuffer(segments.back().outPosition + segments.back().outSize);
+    decodeSegments(inputBuf.data(), inputBuf.size(), segments, decodedBuffer.data(), decodedBuffer.size(), threadPool);
+    return decodedBuffer;
+}
+
+bool LZWDecoder::decode(const std::string &srcFilename, const std::string &outFilename, ThreadPool &threadPool) {
+    auto outFile = openFileForWrite(outFilename);
+
+    auto decodedBuffer = decode(srcFilename, threadPool);
+
+    outFile.write(reinterpret_cast<const char *>(decodedBuffer.data()), (std::streamsize)decodedBuffer.size());
+
+    return true;
+}
+
+void LZWStreamDecoder::reset() {
+    dictionary.resetState();
+    inputBuf.clear();
+    inputPosition = 0;
+    inputEnded = false;
+    bitBuffer = 0;
+    bitCount = 0;
+    pendingCodeId = -1;
+    pendingOffset = 0;
+    finished = false;
+}
+
+void LZWStreamDecoder::feed(const uint8_t *data, size_t size) {
+    // Drop the bytes that have already been moved into bitBuffer before appending the new chunk.
+    inputBuf.erase(inputBuf.begin(), inputBuf.begin() + (long)inputPosition);
+    inputPosition = 0;
+    inputBuf.insert(inputBuf.end(), data, data + size);
+}
+
+void LZWStreamDecoder::endInput() {
+    inputEnded = true;
+}
+
+bool LZWStreamDecoder::needsInput() const {
+    return !finished && !inputEnded && pendingCodeId == -1 && inputPosition == inputBuf.size();
+}
+
+bool LZWStreamDecoder::fillBits(int bitLength) {
+    for (; bitCount < bitLength && inputPosition < inputBuf.size(); bitCount += 8) {
+        bitBuffer |= (uint64_t)inputBuf[inputPosition++] << bitCount;
+    }
+    return bitCount >= bitLength;
+}
+
+size_t LZWStreamDecoder::read(uint8_t *outBuf, size_t outSize) {
+    size_t outPosition = 0;
+    while (outPosition < outSize) {
+        if (pendingCodeId != -1) {
+            // Copy out as much of the current sequence as will fit.
+            int count = std::min(dictionary.getSequenceLength(pendingCodeId) - pendingOffset, (int)std::min(outSize - outPosition, (size_t)LZW_MAX_DICTIONARY_SIZE));
+            dictionary.writeSequence(pendingCodeId, outBuf + outPosition, pendingOffset, count);
+            outPosition += count;
+            pendingOffset += count;
+            if (pendingOffset == dictionary.getSequenceLength(pendingCodeId)) {
+                pendingCodeId = -1;
+            }
+            continue;
+        }
+
+        if (finished) {
+            break;
+        }
+
+        int bitLength = dictionary.getCodeIdBitLength();
+        if (!fillBits(bitLength)) {
+            // Wait for more input unless there isn't any more coming.
+            finished = inputEnded;
+            break;
+        }
+        int nextCodeId = (int)(bitBuffer & ((1u << bitLength) - 1));
+        bitBuffer >>= bitLength;
+        bitCount -= bitLength;
+
+        if (dictionary.isEndOfStream(nextCodeId)) {
+            finished = true;
+            break;
+        }
+        pendingCodeId = dictionary.processCode(nextCodeId);
+        pendingOffset = 0;
+    }
+    return outPosition;
+}
+
+void LZWEncoder::encode(const std::vector<uint8_t> &data, const std::string &outFilename) {
+    auto outFile = openFileForWrite(outFilename);
+
+    auto &lzw = encode(data.data(), data.size());
+
+    outFile.write(reinterpret_cast<const char *>(lzw.data()), (std::streamsize)lzw.size());
     outFile.close();
 }
 
 std::vector<uint8_t> LZWEncoder::encode(const std::vector<uint8_t> &data) {
-    inputBuffer = data;
-    lzwBuffer.clear();
-    curBitPosition = 0;
+    return encode(data.data(), data.size());
+}
+
+const std::vector<uint8_t> &LZWEncoder::encode(const uint8_t *data, size_t size) {
+    encodeChunk(data, size, lzwBuffer, true, true);
+
+    return lzwBuffer;
+}
+
+void LZWEncoder::encode(const std::vector<uint8_t> &data, const std::string &outFilename, ThreadPool &threadPool) {
+    auto outFile = openFileForWrite(outFilename);
+
+    auto &lzw = encode(data.data(), data.size(), threadPool);
+
+    outFile.write(reinterpret_cast<const char *>(lzw.data()), (std::streamsize)lzw.size());
+    outFile.close();
+}
+
+/* Each chunk is encoded on its own worker starting from an empty dictionary, then the chunk bitstreams are
+ * joined at whatever bit position the previous one ended on. Every chunk but the last finishes with a
+ * RESET_DICTIONARY_MARKER so the decoder starts the next one with an empty dictionary too.
+ * Inputs too small to split produce the same output as the single threaded encoder.
+ */
+const std::vector<uint8_t> &LZWEncoder::encode(const uint8_t *data, size_t size, ThreadPool &threadPool) {
+    size_t numChunks = std::max((size_t)1, std::min((size_t)threadPool.getNumThreads(), size / LZW_MIN_PARALLEL_CHUNK_SIZE));
+    std::vector<std::vector<uint8_t>> chunkBuffers(numChunks);
+    std::vector<size_t> chunkBitLengths(numChunks);
+
+    threadPool.parallelFor(numChunks, [&](size_t i) {
+        size_t start = size * i / numChunks;
+        size_t end = size * (i + 1) / numChunks;
+
+        LZWEncoder encoder;
+        encoder.setCompressionLevel(compressionLevel);
+        chunkBitLengths[i] = encoder.encodeChunk(data + start, end - start, chunkBuffers[i], false, i == numChunks - 1);
+    });
+
+    size_t totalBitLength = 0;
+    for (auto bitLength : chunkBitLengths) {
+        totalBitLength += bitLength;
+    }
+
+    bitWriter.reset(lzwBuffer, totalBitLength / 8 + 2);
     resetState();
     writeCodeId(RESET_DICTIONARY_MARKER);
+    for (size_t i = 0; i < numChunks; i++) {
+        bitWriter.appendBits(chunkBuffers[i].data(), chunkBitLengths[i]);
+    }
+    bitWriter.finish();
+
+    return lzwBuffer;
+}
+
+void LZWEncoder::setCompressionLevel(int level) {
+    compressionLevel = std::max(1, std::min(level, LZW_MAX_COMPRESSION_LEVEL));
+}
+
+/* Encodes one chunk into outBuf and returns its length in bits.
+ * Higher compression levels try each parsing mode and reset policy in turn and keep whichever gives the
+ * smallest output.
+ */
+size_t LZWEncoder::encodeChunk(const uint8_t *data, size_t size, std::vector<uint8_t> &outBuf, bool startsStream, bool endsStream) {
+    const int numVariantsForLevel[LZW_MAX_COMPRESSION_LEVEL + 1] = {1, 1, 2, 4, 6};
+    int numVariants = numVariantsForLevel[compressionLevel];
+    size_t bestBitLength = 0;
+    for (int variant = 0; variant < numVariants; variant++) {
+        flexibleParsing = (variant & 1) != 0;
+        adaptiveReset = variant >= 2;
+        freezeFullDictionary = variant >= 4;
+        if (variant == 0) {
+            bestBitLength = encodeChunkCodes(data, size, outBuf, startsStream, endsStream);
+            continue;
+        }
+        size_t bitLength = encodeChunkCodes(data, size, alternateBuffer, startsStream, endsStream);
+        if (bitLength < bestBitLength) {
+            std::swap(outBuf, alternateBuffer);
+            bestBitLength = bitLength;
+        }
+    }
+    return bestBitLength;
+}
+
+size_t LZWEncoder::encodeChunkCodes(const uint8_t *data, size_t size, std::vector<uint8_t> &outBuf, bool startsStream, bool endsStream) {
+    bitWriter.reset(outBuf, size / 2);
+    resetState();
+    if (startsStream) {
+        writeCodeId(RESET_DICTIONARY_MARKER);
+    }
+    encodeCodes(data, size);
+    if (endsStream) {
+        writeCodeId(END_OF_STREAM_MARKER);
+    } else {
+        bitWriter.writeCode(RESET_DICTIONARY_MARKER, getDecoderCodeIdBitLength());
+    }
+    size_t bitLength = bitWriter.getBitPosition();
+    bitWriter.finish();
+    return bitLength;
+}
+
+/* The decoder adds each entry one code later than the encoder and compensates by switching code width
+ * one entry earlier. This gives the width the decoder will use to read the code after the current one.
+ */
+int LZWEncoder::getDecoderCodeIdBitLength() const {
+    int bitLength = 9;
+    for (int change = 0x200; nextAvailableCodeId >= change && bitLength != MAX_CODE_ID_BIT_LENGTH; change <<= 1) {
+        bitLength++;
+    }
+    return bitLength;
+}
 
-    while(curInputPosition < inputBuffer.size()) {
-        Sequence sequence;
-        sequence.emplace_back(inputBuffer[curInputPosition++]);
-        auto newSequence = sequence;
-        while (isSequenceInDictionary(newSequence) && curInputPosition < inputBuffer.size()) {
-            newSequence.emplace_back(inputBuffer[curInputPosition++]);
-            if (isSequenceInDictionary(newSequence)) {
-                sequence = newSequence;
+// Returns the length of the longest dictionary sequence matching the input at position, and its code id.
+int LZWEncoder::findLongestMatch(const uint8_t *data, size_t size, size_t position, int &codeId) const {
+    codeId = data[position];
+    int length = 1;
+    for (size_t i = position + 1; i < size; i++, length++) {
+        int nextCodeId = findCodeId(codeId, data[i]);
+        if (nextCodeId == -1) {
+            break;
+        }
+        codeId = nextCodeId;
+    }
+    return length;
+}
+
+/* Greedy parsing always takes the longest match. Flexible parsing instead picks the match length that
+ * lets the following match reach furthest, which often saves a code. Every prefix of a dictionary
+ * sequence is also in the dictionary so a shorter match can always be emitted. Its new entry may duplicate
+ * an existing sequence, which wastes a code id but is decoded correctly.
+ */
+void LZWEncoder::encodeCodes(const uint8_t *data, size_t size) {
+    size_t curInputPosition = 0;
+    startRatioWindow(curInputPosition);
+    while(curInputPosition < size) {
+        int codeId;
+        int length = findLongestMatch(data, size, curInputPosition, codeId);
+
+        if (flexibleParsing && length > 1 && curInputPosition + length < size) {
+            int unusedCodeId;
+            int bestLength = length;
+            size_t bestReach = length + findLongestMatch(data, size, curInputPosition + length, unusedCodeId);
+            for (int i = length - 1; i > 0; i--) {
+                size_t reach = i + findLongestMatch(data, size, curInputPosition + i, unusedCodeId);
+                if (reach > bestReach) {
+                    bestReach = reach;
+                    bestLength = i;
+                }
+            }
+            if (bestLength != length) {
+                length = bestLength;
+                codeId = data[curInputPosition];
+                for (int i = 1; i < length; i++) {
+                    codeId = findCodeId(codeId, data[curInputPosition + i]);
+                }
             }
         }
-        writeCodeId(dictionary[sequence]);
-        if (sequence.size() != newSequence.size()) {
-            addSequenceToDictionary(newSequence);
-            curInputPosition--;
+
+        writeCodeId(codeId);
+        curInputPosition += length;
+        if (curInputPosition < size) {
+            addSequenceToDictionary(codeId, data[curInputPosition]);
+            if (adaptiveReset && curInputPosition - ratioWindowInputPosition >= LZW_RESET_CHECK_INTERVAL && isCompressionRatioFalling(curInputPosition)) {
+                // The encoder and decoder code widths agree straight after an entry is added.
+                writeCodeId(RESET_DICTIONARY_MARKER);
+                resetState();
+                startRatioWindow(curInputPosition);
+            }
         }
     }
+}
 
-    writeCodeId(END_OF_STREAM_MARKER);
+void LZWEncoder::startRatioWindow(size_t inputPosition) {
+    ratioWindowInputPosition = inputPosition;
+    ratioWindowBitPosition = bitWriter.getBitPosition();
+    bestCompressionRatio = 0;
+}
 
-    return lzwBuffer;
+/* Like compress(1), measure the compression ratio over each window of input and reset the dictionary once
+ * it gets noticeably worse than the best window seen since the last reset.
+ */
+bool LZWEncoder::isCompressionRatioFalling(size_t inputPosition) {
+    uint64_t inputBits = (uint64_t)(inputPosition - ratioWindowInputPosition) * 8;
+    uint64_t outputBits = std::max(bitWriter.getBitPosition() - ratioWindowBitPosition, (size_t)1);
+    uint64_t ratio = (inputBits << 16) / outputBits;
+    ratioWindowInputPosition = inputPosition;
+    ratioWindowBitPosition = bitWriter.getBitPosition();
+
+    if (ratio * 4 < bestCompressionRatio * 3) {
+        return true;
+    }
+    bestCompressionRatio = std::max(bestCompressionRatio, ratio);
+    return false;
+}
+
+static constexpr uint32_t EMPTY_HASH_SLOT = 0xffffffff;
+
+static inline uint32_t hashSlot(uint32_t key) {
+    return (key * 0x9E3779B1u) >> (32 - 13);
 }
 
-bool LZWEncoder::isSequenceInDictionary(Sequence &sequence) {
-    return dictionary.find(sequence) != dictionary.end();
+int LZWEncoder::findCodeId(int prefixCodeId, uint8_t byte) const {
+    uint32_t key = ((uint32_t)prefixCodeId << 8) | byte;
+    for (uint32_t slot = hashSlot(key); dictionary[slot] != EMPTY_HASH_SLOT; slot = (slot + 1) & (LZW_ENCODER_HASH_TABLE_SIZE - 1)) {
+        if (dictionary[slot] >> 12 == key) {
+            return (int)(dictionary[slot] & 0xfff);
+        }
+    }
+    return -1;
 }
 
-void LZWEncoder::addSequenceToDictionary(Sequence &sequence) {
-    dictionary[sequence] = nextAvailableCodeId;
+void LZWEncoder::addSequenceToDictionary(int prefixCodeId, uint8_t byte) {
+    if (dictionaryFrozen) {
+        // The decoder keeps counting entries but once the code width is 12 bits that no longer matters.
+        return;
+    }
+    if (nextAvailableCodeId < LZW_MAX_DICTIONARY_SIZE) {
+        uint32_t key = ((uint32_t)prefixCodeId << 8) | byte;
+        uint32_t slot = hashSlot(key);
+        while (dictionary[slot] != EMPTY_HASH_SLOT) {
+            slot = (slot + 1) & (LZW_ENCODER_HASH_TABLE_SIZE - 1);
+        }
+        dictionary[slot] = key << 12 | nextAvailableCodeId;
+    }
     nextAvailableCodeId++;
 
     if(nextAvailableCodeId >= codeIdBitLengthChange+1) {
         if (currentCodeIdBitLength == MAX_CODE_ID_BIT_LENGTH) {
-            writeCodeId(RESET_DICTIONARY_MARKER);
-            resetState();
+            if (freezeFullDictionary) {
+                // Keep using the full dictionary until the compression ratio starts falling.
+                dictionaryFrozen = true;
+            } else {
+                writeCodeId(RESET_DICTIONARY_MARKER);
+                resetState();
+            }
         } else {
             currentCodeIdBitLength++;
             codeIdBitLengthChange = codeIdBitLengthChange << 1;
@@ -198,33 +668,60 @@ void LZWEncoder::addSequenceToDictionary(Sequence &sequence) {
 }
 
 void LZWEncoder::resetState() {
-    dictionary.clear();
-    for (int i = 0; i < 256; i++) {
-        dictionary[{(uint8_t)i}] = i;
-    }
+    // Single byte sequences are implicit so only the multi-byte entries are stored.
+    std::fill(std::begin(dictionary), std::end(dictionary), EMPTY_HASH_SLOT);
+    dictionaryFrozen = false;
     nextAvailableCodeId = 0x102;
     currentCodeIdBitLength = 9;
     codeIdBitLengthChange = 0x200;
-    previousEmittedSequence.clear();
 }
 
 bool LZWEncoder::writeCodeId(int codeId) {
-//    printf("codeId: %d bitlength: %d\n", codeId, currentCodeIdBitLength);
-//    int byteOffset = curBitPosition / 8;
-    int byteRemainder = curBitPosition % 8;
+    bitWriter.writeCode(codeId, currentCodeIdBitLength);
 
-    if (byteRemainder == 0) {
-        lzwBuffer.emplace_back(codeId & 0xff);
-        lzwBuffer.emplace_back(codeId >> 8);
-    } else {
-        auto byte = lzwBuffer.back();
-        lzwBuffer[lzwBuffer.size()-1] = byte | ((codeId & 0xff) << byteRemainder);
-        lzwBuffer.emplace_back(codeId >> (8 - byteRemainder));
-        if ((8 - byteRemainder) + 8 < currentCodeIdBitLength) {
-            lzwBuffer.emplace_back((codeId >> ((8 - byteRemainder) + 8)));
-        }
+    return false;
+}
+
+void LZWBitWriter::reset(std::vector<uint8_t> &buf, size_t expectedSize) {
+    outputBuf = &buf;
+    outputBuf->resize(std::max(expectedSize + 8, outputBuf->capacity()));
+    bytePosition = 0;
+    bitBuffer = 0;
+    bitCount = 0;
+}
+
+inline void LZWBitWriter::writeCode(int codeId, int bitLength) {
+    writeBits((uint64_t)codeId, bitLength);
+}
+
+// Writes up to 32 bits.
+inline void LZWBitWriter::writeBits(uint64_t bits, int bitLength) {
+    bitBuffer |= bits << bitCount;
+    bitCount += bitLength;
+
+    // Always store all 8 bytes, the partial byte at the end is rewritten by the next flush.
+    if (bytePosition + 8 > outputBuf->size()) {
+        outputBuf->resize(outputBuf->size() * 2);
     }
-    curBitPosition += currentCodeIdBitLength;
+    memcpy(outputBuf->data() + bytePosition, &bitBuffer, 8);
+    bytePosition += bitCount >> 3;
+    bitBuffer >>= bitCount & ~7;
+    bitCount &= 7;
+}
 
-    return false;
+void LZWBitWriter::appendBits(const uint8_t *src, size_t bitLength) {
+    for (; bitLength >= 32; bitLength -= 32, src += 4) {
+        uint32_t word;
+        memcpy(&word, src, 4);
+        writeBits(word, 32);
+    }
+    for (; bitLength > 0; src++) {
+        int count = (int)std::min(bitLength, (size_t)8);
+        writeBits(*src & ((1u << count) - 1), count);
+        bitLength -= count;
+    }
+}
+
+void LZWBitWriter::finish() {
+    outputBuf->resize(bytePosition + (bitCount + 7) / 8);
 }
@@ -24,63 +24,215 @@ SOFTWARE.
 #ifndef TD3EXTRACT_LZW_H
 #define TD3EXTRACT_LZW_H
 
+#include <cstdint>
 #include <fstream>
 #include <string>
-#include <map>
 #include <vector>
 
-typedef std::vector<uint8_t> Sequence;
+constexpr int LZW_MAX_DICTIONARY_SIZE = 0x1000; // 12-bit code ids.
 
-class LZWDecoder {
+/* Dictionary entries are stored as a link to their prefix entry plus the last byte of the sequence.
+ * The full sequence is recovered by walking the prefix links back to a single byte entry.
+ */
+struct LZWDictionaryEntry {
+    uint16_t prefixCodeId;
+    uint16_t length;
+    uint8_t firstByte;
+    uint8_t lastByte;
+};
+
+/* Reads little endian variable width codes from a byte buffer.
+ * Bits are loaded 64 at a time into an accumulator so each code is a single shift and mask.
+ */
+class LZWBitReader {
+private:
+    const uint8_t *inputBuf = nullptr;
+    size_t inputSize = 0;
+    size_t bytePosition = 0;
+    uint64_t bitBuffer = 0;
+    int bitCount = 0;
+
+public:
+    void reset(const uint8_t *buf, size_t size);
+    int readCode(int bitLength);
+    bool hasBits(int bitLength) const;
+
+private:
+    void refill();
+};
+
+/* The decoder side dictionary and code width state shared by the decoders below.
+ * Codes are fed in one at a time with processCode() which returns the id of the sequence to emit, if any.
+ */
+class LZWDictionary {
 private:
-    std::ifstream srcFile;
-    std::vector<uint8_t> decodedBuffer;
-    std::map<int, Sequence> dictionary;
+    LZWDictionaryEntry dictionary[LZW_MAX_DICTIONARY_SIZE];
     int nextAvailableCodeId = 0x102;
     int currentCodeIdBitLength = 9;
     int codeIdBitLengthChange = 0x200;
 
-    Sequence previousEmittedSequence;
+    int previousEmittedCodeId = -1;
+    bool expectingLiteral = false;
+public:
+    LZWDictionary();
+    void resetState();
+    int getCodeIdBitLength() const { return currentCodeIdBitLength; }
+    bool isEndOfStream(int codeId) const;
+    bool isResetMarker(int codeId) const;
+    int processCode(int codeId);
+    int getSequenceLength(int codeId) const { return dictionary[codeId].length; }
+    void writeSequence(int codeId, uint8_t *out, int offset, int count) const;
+
+private:
+    bool isCodeIdInDictionary(int codeId) const;
+    int addSequenceToDictionary(int prefixCodeId, uint8_t byte);
+};
 
-    unsigned char *inputBuf = nullptr;
-    int inputSize = 0;
-    int curBitPosition = 0;
+class ThreadPool;
+
+/* A run of codes that can be decoded on its own.
+ * Every RESET_DICTIONARY_MARKER starts a new segment as the dictionary is rebuilt from scratch.
+ */
+struct LZWSegment {
+    size_t bitPosition = 0;
+    bool startsAfterReset = false;
+    bool endsAtReset = false;
+    size_t outPosition = 0;
+    size_t outSize = 0;
+};
+
+class LZWDecoder {
+private:
+    LZWDictionary dictionary;
+    LZWBitReader bitReader;
 public:
-    LZWDecoder();
     bool decode(const std::string &srcFilename, const std::string &outFilename);
     std::vector<uint8_t> decode(const std::string &srcFilename);
+    size_t decodedSize(const std::string &srcFilename);
+
+    // Decode directly from memory. Writes at most outSize bytes and returns the full decoded size.
+    size_t decode(const uint8_t *src, size_t srcSize, uint8_t *outBuf, size_t outSize);
+    size_t decodedSize(const uint8_t *src, size_t srcSize);
+
+    // Multi-threaded versions. The segments between dictionary resets are decoded in parallel.
+    bool decode(const std::string &srcFilename, const std::string &outFilename, ThreadPool &threadPool);
+    std::vector<uint8_t> decode(const std::string &srcFilename, ThreadPool &threadPool);
+    size_t decode(const uint8_t *src, size_t srcSize, uint8_t *outBuf, size_t outSize, ThreadPool &threadPool);
 
 private:
-    void resetState();
-    int getNextCodeFromInput();
-    bool isCodeIdInDictionary(int codeId);
-    void writeSequenceToFile(Sequence &sequence);
-    void addSequenceToDictionary(Sequence &sequence);
+    template <bool WriteOutput>
+    size_t decodeCodes(const uint8_t *src, size_t srcSize, const LZWSegment &segment, uint8_t *outBuf, size_t outSize);
+    static std::vector<LZWSegment> findSegments(const uint8_t *src, size_t srcSize, ThreadPool &threadPool);
+    static void decodeSegments(const uint8_t *src, size_t srcSize, const std::vector<LZWSegment> &segments, uint8_t *outBuf, size_t outSize, ThreadPool &threadPool);
+};
+
+/* Incremental decoder. Compressed input is pushed in with feed() and decoded output is pulled out with read()
+ * in chunks of any size. Only unconsumed input bits and the dictionary are held between calls.
+ */
+class LZWStreamDecoder {
+private:
+    LZWDictionary dictionary;
+    std::vector<uint8_t> inputBuf;
+    size_t inputPosition = 0;
+    bool inputEnded = false;
+    uint64_t bitBuffer = 0;
+    int bitCount = 0;
+
+    int pendingCodeId = -1;
+    int pendingOffset = 0;
+    bool finished = false;
+public:
+    void reset();
+    void feed(const uint8_t *data, size_t size);
+    void endInput();
+    size_t read(uint8_t *outBuf, size_t outSize);
+    bool isFinished() const { return finished; }
+    bool needsInput() const;
+
+private:
+    bool fillBits(int bitLength);
 };
 
+/* Packs little endian variable width codes into a byte buffer.
+ * Codes are OR'd into a 64-bit accumulator and whole bytes are flushed with a single 8 byte store.
+ */
+class LZWBitWriter {
+private:
+    std::vector<uint8_t> *outputBuf = nullptr;
+    size_t bytePosition = 0;
+    uint64_t bitBuffer = 0;
+    int bitCount = 0;
+
+public:
+    // Starts writing to buf. Its existing capacity is reused.
+    void reset(std::vector<uint8_t> &buf, size_t expectedSize);
+    void writeCode(int codeId, int bitLength);
+    void writeBits(uint64_t bits, int bitLength);
+    // Appends a bitstream starting at any bit position.
+    void appendBits(const uint8_t *src, size_t bitLength);
+    size_t getBitPosition() const { return bytePosition * 8 + bitCount; }
+    // Trims buf down to the bytes written.
+    void finish();
+};
+
+constexpr int LZW_ENCODER_HASH_TABLE_SIZE = 0x2000;
+// Inputs are only split for parallel encoding if each thread gets at least this much.
+constexpr size_t LZW_MIN_PARALLEL_CHUNK_SIZE = 0x10000;
+constexpr int LZW_MAX_COMPRESSION_LEVEL = 4;
+// Input bytes between compression ratio checks when using adaptive dictionary resets.
+constexpr size_t LZW_RESET_CHECK_INTERVAL = 0x1000;
+
 class LZWEncoder {
 private:
-    std::vector<uint8_t> inputBuffer;
     std::vector<uint8_t> lzwBuffer;
-    std::map<Sequence, int> dictionary;
+    std::vector<uint8_t> alternateBuffer;
+    LZWBitWriter bitWriter;
+    // Open addressing hash table mapping (prefix code id, next byte) -> code id.
+    // Each slot packs the 20 bit key above the 12 bit code id.
+    uint32_t dictionary[LZW_ENCODER_HASH_TABLE_SIZE];
     int nextAvailableCodeId = 0x102;
     int currentCodeIdBitLength = 9;
     int codeIdBitLengthChange = 0x200;
 
-    Sequence previousEmittedSequence;
-
-    int curBitPosition = 0;
-    int curInputPosition = 0;
+    int compressionLevel = 1;
+    bool flexibleParsing = false;
+    bool adaptiveReset = false;
+    bool freezeFullDictionary = false;
+    bool dictionaryFrozen = false;
+    size_t ratioWindowInputPosition = 0;
+    size_t ratioWindowBitPosition = 0;
+    uint64_t bestCompressionRatio = 0;
 public:
     LZWEncoder() = default;
+    // Level 1 is plain greedy LZW, as used by the original game files.
+    // Level 2 also tries flexible parsing and keeps whichever output is smaller.
+    // Level 3 also tries resetting the dictionary early when the compression ratio starts falling.
+    // Level 4 also tries keeping a full dictionary instead of resetting it. The original encoder never does
+    // this, so it relies on the decoder tolerating codes past 4096 entries without a reset.
+    void setCompressionLevel(int level);
     std::vector<uint8_t> encode(const std::vector<uint8_t> &data);
     void encode(const std::vector<uint8_t> &data, const std::string &outFilename);
 
+    // Encodes directly from memory without copying the input.
+    // The returned buffer belongs to the encoder and is reused by the next call.
+    const std::vector<uint8_t> &encode(const uint8_t *data, size_t size);
+
+    // Multi-threaded versions. The input is split into chunks that are each encoded from a fresh dictionary.
+    void encode(const std::vector<uint8_t> &data, const std::string &outFilename, ThreadPool &threadPool);
+    const std::vector<uint8_t> &encode(const uint8_t *data, size_t size, ThreadPool &threadPool);
+
 private:
+    size_t encodeChunk(const uint8_t *data, size_t size, std::vector<uint8_t> &outBuf, bool startsStream, bool endsStream);
+    size_t encodeChunkCodes(const uint8_t *data, size_t size, std::vector<uint8_t> &outBuf, bool startsStream, bool endsStream);
+    void encodeCodes(const uint8_t *data, size_t size);
+    int findLongestMatch(const uint8_t *data, size_t size, size_t position, int &codeId) const;
+    void startRatioWindow(size_t inputPosition);
+    bool isCompressionRatioFalling(size_t inputPosition);
+    int getDecoderCodeIdBitLength() const;
     void resetState();
     bool writeCodeId(int codeId);
-    bool isSequenceInDictionary(Sequence &sequence);
-    void addSequenceToDictionary(Sequence &sequence);
+    int findCodeId(int prefixCodeId, uint8_t byte) const;
+    void addSequenceToDictionary(int prefixCodeId, uint8_t byte);
 };
 
 #endif //TD3EXTRACT_LZW_H
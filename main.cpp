@@ -21,15 +21,23 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
+#include <algorithm>
 #include <iostream>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
 #include <map>
+#include <mutex>
 #include <fstream>
 #include <string>
 #include <vector>
 #include <sstream>
+#include "archive.h"
 #include "file.h"
 #include "lzw.h"
 #include "image.h"
+#include "index.h"
+#include "threadpool.h"
 
 short calcHash1(const std::string &filename, short seed) {
     int hash = 0;
@@ -54,14 +62,6 @@ int calcFilenameHash(const std::string &filename) {
     return ((int)h1 << 16) + h2;
 }
 
-#pragma pack(1)
-struct DataArchiveFileStruct {
-    unsigned int id;
-    short archiveFileId;
-    unsigned int offset;
-    unsigned int size;
-};
-
 struct PlayDisk {
     std::vector<std::string> cars;
     std::vector<std::string> scenes;
@@ -136,6 +136,29 @@ char carFilenameSuffixes[][13] = {
         "COL.BIN"
 };
 
+struct CarImageInfo {
+    char suffix[13];
+    int width;
+    char paletteSuffix[13];
+};
+
+/* From info/files.MD
+ * .SIC images are left out. Their palette is only the tail of the main menu palette.
+ */
+CarImageInfo carImages[] = {
+        {".TOP",   320, "COL.BIN"},
+        {"1.BOT",  320, "COL.BIN"},
+        {"2.BOT",  320, "COL.BIN"},
+        {"L.BOT",  168, "COL.BIN"},
+        {"R.BOT",  168, "COL.BIN"},
+        {".ETC",   72,  "COL.BIN"},
+        {"FL1.LZ", 208, "SC.BIN"},
+        {"FL2.LZ", 208, "SC.BIN"},
+        {".BIC",   112, "SC.BIN"},
+        {".ICN",   208, "SC.BIN"},
+        {".SID",   112, "SC.BIN"}
+};
+
 char sceneFilenameSuffixes[][13] = {
         ".ICN",
         ".SIC",
@@ -170,8 +193,10 @@ char sceneFilenameSuffixes[][13] = {
 
 
 
-std::ifstream openTD3ExeForRead() {
-    return openFileForRead("TD3.EXE");
+// TD3.EXE is loaded once and shared by everything that needs it.
+const std::vector<uint8_t> &loadTD3Exe() {
+    static const std::vector<uint8_t> exeData = loadFile("TD3.EXE");
+    return exeData;
 }
 
 PlayDisk loadPlayDisk() {
@@ -210,6 +235,14 @@ std::vector<DataArchiveFileStruct> readFileInfoTbl(std::ifstream &fp, int startO
     return infoTable;
 }
 
+std::vector<DataArchiveFileStruct> readFileInfoTbl(const std::vector<uint8_t> &data, int startOffset, int numRecords) {
+    std::vector<DataArchiveFileStruct> infoTable(numRecords);
+    size_t tableOffset = std::min(data.size(), (size_t)startOffset);
+    size_t tableSize = std::min((size_t)numRecords * sizeof(DataArchiveFileStruct), data.size() - tableOffset);
+    memcpy(infoTable.data(), data.data() + tableOffset, tableSize);
+    return infoTable;
+}
+
 
 
 std::string getoutputFilename(const std::map<unsigned int, std::string> &filenames, const DataArchiveFileStruct &fileInfo) {
@@ -223,72 +256,120 @@ std::string getoutputFilename(const std::map<unsigned int, std::string> &filenam
     }
 }
 
-void dumpFile(const std::map<unsigned int, std::string> &filenames, const DataArchiveFileStruct &fileInfo, const std::string &dataFilename) {
-    std::ifstream archiveFile;
-    unsigned char buf[0xffff];
+struct ExtractJob {
+    ArchiveEntry entry;
+    std::string archiveFilename;
+    std::string outputFilename;
+    bool isOverwritten = false;
+    bool isWritten = true;
+};
 
-    switch (fileInfo.archiveFileId) {
-        case 'a' :  archiveFile = openFileForRead("DATAA.DAT"); break;
-        case 'b' :  archiveFile = openFileForRead("DATAB.DAT"); break;
-        case 'c' :  archiveFile = openFileForRead("DATAC.DAT"); break;
-        case 'd' :
-        case 'e' :  archiveFile = openFileForRead(dataFilename); break;
-        default: return;
+void addExtractJob(std::vector<ExtractJob> &jobs, ArchiveSet &archives, const std::map<unsigned int, std::string> &filenames, const DataArchiveFileStruct &fileInfo, const std::string &dataFilename) {
+    ExtractJob job;
+    if (!archives.getEntry(fileInfo, dataFilename, job.entry)) {
+        return;
     }
+    job.archiveFilename = ArchiveSet::getArchiveFilename(fileInfo.archiveFileId, dataFilename);
+    job.outputFilename = getoutputFilename(filenames, fileInfo);
+    jobs.emplace_back(job);
+}
 
-    auto outputFilename = getoutputFilename(filenames, fileInfo);
-    auto outFile = openFileForWrite(outputFilename);
-
-    std::cout << "Extracting: " << outputFilename << "\n";
+/* Writes out all the entries on the thread pool. Progress is printed in job order so the log
+ * matches a single threaded run. Returns false if any file failed to be written.
+ */
+bool extractFiles(std::vector<ExtractJob> &jobs, ThreadPool &threadPool) {
+    // Only the last entry written to a given filename needs extracting.
+    std::map<std::string, size_t> lastJobForFilename;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        auto previousJob = lastJobForFilename.find(jobs[i].outputFilename);
+        if (previousJob != lastJobForFilename.end()) {
+            jobs[previousJob->second].isOverwritten = true;
+        }
+        lastJobForFilename[jobs[i].outputFilename] = i;
+    }
 
-    archiveFile.seekg(fileInfo.offset);
-    archiveFile.read((char *)buf, fileInfo.size - 1);
-    outFile.write((char *)buf, fileInfo.size - 1);
+    std::mutex outputMutex;
+    std::vector<bool> isJobDone(jobs.size(), false);
+    size_t nextJobToReport = 0;
+    bool isAllWritten = true;
+    threadPool.parallelFor(jobs.size(), [&](size_t i) {
+        if (!jobs[i].isOverwritten) {
+            jobs[i].isWritten = ArchiveSet::writeEntry(jobs[i].entry, jobs[i].outputFilename);
+        }
 
-    outFile.close();
-    archiveFile.close();
+        std::lock_guard<std::mutex> lock(outputMutex);
+        isJobDone[i] = true;
+        for (; nextJobToReport < jobs.size() && isJobDone[nextJobToReport]; nextJobToReport++) {
+            auto &job = jobs[nextJobToReport];
+            std::cout << "Extracting: " << job.outputFilename << "\n";
+            if (!job.isWritten) {
+                std::cout << "Error: Failed writing to '" << job.outputFilename << "'.\n";
+                isAllWritten = false;
+            }
+        }
+    });
+    return isAllWritten;
 }
 
-int findOffsetOfFileInfoTable(std::ifstream &td3File) {
-    int offset = 0;
-    td3File.seekg(0, std::ios_base::end);
-    int size = (int)td3File.tellg();
-
-    for (; offset < size - 4; offset++) {
-        int id = 0;
-        td3File.seekg(offset);
-        for (int i = 0; i < 4; i++) {
-            char byte;
-            td3File.read(&byte, 1);
-            id += (int)byte << ((3 - i) * 8);
+constexpr int ENGINE_FILE_INFO_TABLE_SIZE = 49;
+// Number of records checked when deciding whether a signature match really is the file info table.
+constexpr int FILE_INFO_TABLE_CHECK_SIZE = 4;
+
+bool isFileInfoTable(const std::vector<uint8_t> &exeData, size_t offset) {
+    auto fileInfoTable = readFileInfoTbl(exeData, (int)offset, FILE_INFO_TABLE_CHECK_SIZE);
+    if (offset + fileInfoTable.size() * sizeof(DataArchiveFileStruct) > exeData.size()) {
+        return false;
+    }
+    for (auto &fileInfo : fileInfoTable) {
+        if (fileInfo.archiveFileId < 'a' || fileInfo.archiveFileId > 'e' || fileInfo.size == 0 || fileInfo.size > 0x1000000) {
+            return false;
         }
-        if (id == 0xEF0E4D4C) { // The id of the first entry in the table.
+    }
+    return true;
+}
+
+/* Searches for the id of the first entry in the table. Matches that aren't followed by sensible
+ * records are skipped, though the first match is still used if none of them look right.
+ */
+int findOffsetOfFileInfoTable(const std::vector<uint8_t> &exeData) {
+    const uint8_t signature[4] = {0xEF, 0x0E, 0x4D, 0x4C};
+    int firstMatchOffset = -1;
+    auto match = exeData.begin();
+    while ((match = std::search(match, exeData.end(), std::begin(signature), std::end(signature))) != exeData.end()) {
+        int offset = (int)(match - exeData.begin());
+        if (isFileInfoTable(exeData, offset)) {
             return offset;
         }
+        if (firstMatchOffset == -1) {
+            firstMatchOffset = offset;
+        }
+        ++match;
     }
 
-    std::cout << "Error: Failed to find start of FileInfoTable in TD3.EXE.\n";
-    exit(1);
+    if (firstMatchOffset == -1) {
+        std::cout << "Error: Failed to find start of FileInfoTable in TD3.EXE.\n";
+        exit(1);
+    }
+    return firstMatchOffset;
 }
 
-void dumpEngineFiles() {
-    auto fp = openTD3ExeForRead();
+void findEngineFiles(std::vector<ExtractJob> &jobs, ArchiveSet &archives) {
+    auto &exeData = loadTD3Exe();
 
     std::map<unsigned int, std::string> filenameIdMap;
     for( auto &filename : engineFilenames) {
         filenameIdMap[calcFilenameHash(filename)] = filename;
     }
 
-    auto offset = findOffsetOfFileInfoTable(fp);
-    auto fileInfoTable = readFileInfoTbl(fp, offset, 49);
+    auto offset = findOffsetOfFileInfoTable(exeData);
+    auto fileInfoTable = readFileInfoTbl(exeData, offset, ENGINE_FILE_INFO_TABLE_SIZE);
 
     for (auto &fileInfo : fileInfoTable) {
-        dumpFile(filenameIdMap, fileInfo, "");
+        addExtractJob(jobs, archives, filenameIdMap, fileInfo, "");
     }
-    fp.close();
 }
 
-void dumpCar(const std::string &carFilename) {
+void findCarFiles(std::vector<ExtractJob> &jobs, ArchiveSet &archives, const std::string &carFilename) {
     auto listFile = openFileForRead(carFilename + ".LST");
     auto fileInfoTable = readFileInfoTbl(listFile, 0x1d1, 15);
     listFile.close();
@@ -300,17 +381,17 @@ void dumpCar(const std::string &carFilename) {
     }
 
     for (auto &fileInfo : fileInfoTable) {
-        dumpFile(filenameIdMap, fileInfo, carFilename + ".DAT");
+        addExtractJob(jobs, archives, filenameIdMap, fileInfo, carFilename + ".DAT");
     }
 }
 
-void dumpCarFiles(PlayDisk &playDisk) {
+void findCarFiles(std::vector<ExtractJob> &jobs, ArchiveSet &archives, PlayDisk &playDisk) {
     for (auto &car : playDisk.cars) {
-        dumpCar(car);
+        findCarFiles(jobs, archives, car);
     }
 }
 
-void dumpScene(const std::string &sceneFilename) {
+void findSceneFiles(std::vector<ExtractJob> &jobs, ArchiveSet &archives, const std::string &sceneFilename) {
     auto listFile = openFileForRead(sceneFilename + ".LST");
     auto fileInfoTable = readFileInfoTbl(listFile, 0x4d0, 29);
     listFile.close();
@@ -322,29 +403,124 @@ void dumpScene(const std::string &sceneFilename) {
     }
 
     for (auto &fileInfo : fileInfoTable) {
-        dumpFile(filenameIdMap, fileInfo, sceneFilename + ".DAT");
+        addExtractJob(jobs, archives, filenameIdMap, fileInfo, sceneFilename + ".DAT");
     }
 }
 
-void dumpSceneFiles(PlayDisk &playDisk) {
+void findSceneFiles(std::vector<ExtractJob> &jobs, ArchiveSet &archives, PlayDisk &playDisk) {
     for (auto &scene : playDisk.scenes) {
-        dumpScene(scene);
+        findSceneFiles(jobs, archives, scene);
     }
 }
 
-void patchExe() {
-    auto originalFile = openTD3ExeForRead();
-    auto patchedFile = openFileForWrite("TD3_U.EXE");
+/* Converts every car image found in the current directory to PNG.
+ * Images whose file or palette hasn't been extracted are skipped.
+ */
+void extractAllCarImages(PlayDisk &playDisk, ThreadPool &threadPool) {
+    struct ImageJob {
+        std::string filename;
+        int width;
+        std::string paletteFilename;
+    };
+    std::vector<ImageJob> jobs;
+    for (auto &car : playDisk.cars) {
+        for (auto &imageInfo : carImages) {
+            ImageJob job = {car + imageInfo.suffix, imageInfo.width, car + imageInfo.paletteSuffix};
+            if (std::filesystem::exists(job.filename) && std::filesystem::exists(job.paletteFilename)) {
+                jobs.emplace_back(job);
+            }
+        }
+    }
+
+    std::mutex outputMutex;
+    threadPool.parallelFor(jobs.size(), [&](size_t i) {
+        auto &job = jobs[i];
+        Image image;
+        bool isLoaded = image.loadTD3LZImageFile(job.filename, job.width, job.paletteFilename);
+        bool isSaved = isLoaded && image.savePngFile(job.filename + ".png");
+
+        std::lock_guard<std::mutex> lock(outputMutex);
+        if (!isLoaded) {
+            std::cout << "Skipped: " << job.filename << " doesn't fit a width of " << job.width << "\n";
+        } else if (!isSaved) {
+            std::cout << "Skipped: " << job.filename << ".png couldn't be written\n";
+        } else {
+            std::cout << "Extracted: " << job.filename << ".png\n";
+        }
+    });
+}
+
+const char TD3_INDEX_FILENAME[] = "td3.idx";
+
+/* Returns every file in the game archives. They come from td3.idx if it is up to date, otherwise
+ * they are found from the file tables in TD3.EXE and the .LST files and the index is rebuilt.
+ */
+std::vector<ArchiveIndexEntry> loadArchiveIndex(ArchiveSet &archives) {
+    std::vector<ArchiveIndexEntry> entries;
+    ArchiveIndex index;
+    if (index.load(TD3_INDEX_FILENAME)) {
+        for (size_t i = 0; i < index.getNumEntries(); i++) {
+            entries.emplace_back(index.getEntry(i));
+        }
+        return entries;
+    }
 
-    originalFile.seekg(0, std::ios_base::end);
-    int size = (int)originalFile.tellg();
+    auto playdisk = loadPlayDisk();
+    std::vector<ExtractJob> jobs;
+    findEngineFiles(jobs, archives);
+    findCarFiles(jobs, archives, playdisk);
+    findSceneFiles(jobs, archives, playdisk);
 
-    char *buf = new char[size];
-    originalFile.seekg(0);
-    originalFile.read(buf, size);
+    std::vector<std::string> sourceFilenames = {"TD3.EXE", "PLAYDISK.DAT"};
+    for (auto &car : playdisk.cars) {
+        sourceFilenames.emplace_back(car + ".LST");
+    }
+    for (auto &scene : playdisk.scenes) {
+        sourceFilenames.emplace_back(scene + ".LST");
+    }
+    for (auto &job : jobs) {
+        if (std::find(sourceFilenames.begin(), sourceFilenames.end(), job.archiveFilename) == sourceFilenames.end()) {
+            sourceFilenames.emplace_back(job.archiveFilename);
+        }
+        entries.push_back({job.archiveFilename, job.outputFilename, (uint32_t)job.entry.offset, (uint32_t)job.entry.size,
+                           ArchiveIndex::hashContent(job.entry.data, job.entry.size)});
+    }
 
+    // Failing to write the index only means the next run has to find the files again.
+    ArchiveIndex::save(TD3_INDEX_FILENAME, sourceFilenames, entries);
+    return entries;
+}
 
-    auto fileInfoTableOffset = findOffsetOfFileInfoTable(originalFile);
+std::vector<ExtractJob> findExtractJobs(ArchiveSet &archives) {
+    std::vector<ExtractJob> jobs;
+    for (auto &indexEntry : loadArchiveIndex(archives)) {
+        ExtractJob job;
+        if (!archives.getEntry(indexEntry.archiveFilename, indexEntry.offset, indexEntry.size, job.entry)) {
+            std::cout << "Error: " << indexEntry.filename << " lies outside " << indexEntry.archiveFilename << "\n";
+            continue;
+        }
+        job.archiveFilename = indexEntry.archiveFilename;
+        job.outputFilename = indexEntry.filename;
+        jobs.emplace_back(job);
+    }
+    return jobs;
+}
+
+void listFiles() {
+    ArchiveSet archives;
+    for (auto &entry : loadArchiveIndex(archives)) {
+        std::cout << std::left << std::setw(13) << entry.filename << " " << std::setw(12) << entry.archiveFilename
+                  << std::right << std::hex << " offset: 0x" << std::setfill('0') << std::setw(8) << entry.offset
+                  << std::dec << std::setfill(' ') << " size: " << std::setw(7) << entry.size
+                  << std::hex << " hash: " << std::setfill('0') << std::setw(16) << entry.contentHash
+                  << std::dec << std::setfill(' ') << "\n";
+    }
+}
+
+void patchExe() {
+    std::vector<uint8_t> buf = loadTD3Exe();
+
+    auto fileInfoTableOffset = findOffsetOfFileInfoTable(buf);
 
     std::cout << "Found offset of file info table at 0x" << std::hex << fileInfoTableOffset << "\n";
     std::cout << "Patching TD3.EXE -> TD3_U.EXE\n";
@@ -357,57 +533,141 @@ void patchExe() {
         buf[fileInfoTableOffset + i] = 0;
     }
 
-    patchedFile.write(buf, size);
-
-    originalFile.close();
+    auto patchedFile = openFileForWrite("TD3_U.EXE");
+    patchedFile.write(reinterpret_cast<const char *>(buf.data()), (std::streamsize)buf.size());
     patchedFile.close();
 
     std::cout << "Done.\n";
-    delete[] buf;
 }
 
 void printUsage(char **argv) {
     std::cout << "\nUsage: " << argv[0] << " option\n\n";
     std::cout << "Options:\n";
     std::cout << "  -extractFiles                          : Extract files\n";
+    std::cout << "  -listFiles                             : List the files packed in the game archives\n";
     std::cout << "  -patchEXE                              : Patch TD3.EXE to use extracted files\n";
     std::cout << "  -decompressLZW inLZFile outFile        : Decompress LZW compressed file.\n";
+    std::cout << "  -compressLZW inFile outLZFile          : Compress file with LZW.\n";
     std::cout << "  -unpackRLE inFile outFile              : Decompress RLE compressed file.\n";
     std::cout << "  -extractImage inFile width paletteFile : Decompress packed game image file\n";
     std::cout << "                                           into PNG file.\n";
+    std::cout << "  -extractAllImages                      : Convert all extracted car images into PNG files.\n";
+    std::cout << "                                           .SIC icons are skipped as their palette is only\n";
+    std::cout << "                                           the end of the main menu palette.\n";
     std::cout << "  -encodeImage inFile outFile            : Compress PNG image into RLE+LZW\n";
     std::cout << "                                           encoded format for use by the game.\n\n";
+    std::cout << "  -j numThreads                          : Number of threads to use. Defaults to 1.\n";
+    std::cout << "  -level n                               : LZW compression level for -compressLZW and\n";
+    std::cout << "                                           -encodeImage. 1 (default) matches the original\n";
+    std::cout << "                                           game encoder. 2 and 3 search for smaller output.\n";
+    std::cout << "                                           4 also lets a full dictionary go without a reset,\n";
+    std::cout << "                                           which the original encoder never does. The game\n";
+    std::cout << "                                           has not been shown to accept level 4 output.\n";
+    std::cout << "  -optimizeRLE                           : Let -encodeImage split RLE runs differently if\n";
+    std::cout << "                                           it makes the LZW output smaller. The pixels are\n";
+    std::cout << "                                           unchanged but the packed RLE size changes, which\n";
+    std::cout << "                                           some files have hardcoded in the EXE.\n\n";
 
     exit(1);
 }
 
+// Removes a flag from the argument list and returns whether it was present.
+bool removeFlag(int &argc, char **argv, const char *name) {
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], name)) {
+            for (int j = i; j + 1 < argc; j++) {
+                argv[j] = argv[j + 1];
+            }
+            argc--;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Removes "name value" from the argument list and returns the value, or nullptr if the option isn't present.
+const char *removeOption(int &argc, char **argv, const char *name) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (!strcmp(argv[i], name)) {
+            const char *value = argv[i + 1];
+            for (int j = i; j + 2 < argc; j++) {
+                argv[j] = argv[j + 2];
+            }
+            argc -= 2;
+            return value;
+        }
+    }
+    return nullptr;
+}
+
 int main(int argc, char **argv) {
     std::map<unsigned int,std::string> fileNameMap;
 
+    int numThreads = 1;
+    if (auto value = removeOption(argc, argv, "-j")) {
+        numThreads = std::max(1, std::atoi(value));
+    }
+    int compressionLevel = 1;
+    if (auto value = removeOption(argc, argv, "-level")) {
+        compressionLevel = std::atoi(value);
+    }
+    bool optimizeRLE = removeFlag(argc, argv, "-optimizeRLE");
+
     if (argc < 2) {
         printUsage(argv);
     }
 
     if (!strcmp(argv[1], "-extractFiles")) {
-        auto playdisk = loadPlayDisk();
-        dumpEngineFiles();
-        dumpCarFiles(playdisk);
-        dumpSceneFiles(playdisk);
+        ArchiveSet archives;
+        auto jobs = findExtractJobs(archives);
+
+        ThreadPool threadPool(numThreads);
+        if (!extractFiles(jobs, threadPool)) {
+            return 1;
+        }
+    } else if (!strcmp(argv[1], "-listFiles")) {
+        listFiles();
     } else if (!strcmp(argv[1], "-patchEXE")) {
         patchExe();
     } else if (!strcmp(argv[1], "-decompressLZW") && argc >= 4) {
         LZWDecoder lzwDecoder;
-        lzwDecoder.decode(argv[2], argv[3]);
+        if (numThreads > 1) {
+            ThreadPool threadPool(numThreads);
+            lzwDecoder.decode(argv[2], argv[3], threadPool);
+        } else {
+            lzwDecoder.decode(argv[2], argv[3]);
+        }
+    } else if (!strcmp(argv[1], "-compressLZW") && argc >= 4) {
+        LZWEncoder lzwEncoder;
+        lzwEncoder.setCompressionLevel(compressionLevel);
+        if (numThreads > 1) {
+            ThreadPool threadPool(numThreads);
+            lzwEncoder.encode(loadFile(argv[2]), argv[3], threadPool);
+        } else {
+            lzwEncoder.encode(loadFile(argv[2]), argv[3]);
+        }
     } else if (!strcmp(argv[1], "-unpackRLE") && argc >= 4) {
         unpackRLEImage(argv[2], argv[3]);
     } else if (!strcmp(argv[1], "-extractImage") && argc >= 5) {
         Image image;
-        image.loadTD3LZImageFile(argv[2], std::atoi(argv[3]), argv[4]);
+        if (!image.loadTD3LZImageFile(argv[2], std::atoi(argv[3]), argv[4])) {
+            std::cout << "Error: insufficient image data for specified width: " << argv[3] << "\n\n";
+            exit(1);
+        }
         image.savePngFile(std::string(argv[2]) + ".png");
+    } else if (!strcmp(argv[1], "-extractAllImages")) {
+        auto playdisk = loadPlayDisk();
+        ThreadPool threadPool(numThreads);
+        extractAllCarImages(playdisk, threadPool);
     } else if (!strcmp(argv[1], "-encodeImage") && argc >= 4) {
         Image image;
         image.loadPngFile(argv[2]);
-        image.saveLZWFile(std::string(argv[3]));
+        if (numThreads > 1) {
+            ThreadPool threadPool(numThreads);
+            image.saveLZWFile(std::string(argv[3]), &threadPool, compressionLevel, optimizeRLE);
+        } else {
+            image.saveLZWFile(std::string(argv[3]), nullptr, compressionLevel, optimizeRLE);
+        }
     } else {
         printUsage(argv);
     }
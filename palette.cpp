@@ -0,0 +1,88 @@
+/*
+MIT License
+
+Copyright (c) 2023 Eric Fry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include "palette.h"
+#include "file.h"
+
+// The first 16 colours are fixed. The palette files hold the remaining 112 as 6-bit VGA values.
+const static uint8_t basePal[48] = {
+        0x00, 0x00, 0x00,
+        0x00, 0x00, 0x28,
+        0x00, 0x28, 0x00,
+        0x00, 0x28, 0x28,
+        0x28, 0x00, 0x00,
+        0x28, 0x00, 0x28,
+        0x28, 0x14, 0x00,
+        0x28, 0x28, 0x28,
+        0x14, 0x14, 0x14,
+        0x14, 0x14, 0x3c,
+        0x14, 0x3c, 0x14,
+        0x14, 0x3c, 0x3c,
+        0x3c, 0x14, 0x14,
+        0x3c, 0x14, 0x3c,
+        0x3c, 0x3c, 0x14,
+        0x3c, 0x3c, 0x3c
+};
+
+constexpr size_t PALETTE_FILE_DATA_SIZE = 336;
+
+Palette::Palette(const std::vector<uint8_t> &paletteFileData) {
+    rgb.reserve(sizeof(basePal) + PALETTE_FILE_DATA_SIZE);
+    for (auto c : basePal) {
+        rgb.emplace_back(c << 2);
+    }
+    for (size_t i = 0; i < PALETTE_FILE_DATA_SIZE; i++) {
+        uint8_t c = i < paletteFileData.size() ? paletteFileData[i] : 0;
+        rgb.emplace_back(c << 2);
+    }
+
+    lodepng_color_mode_init(&colorMode);
+    colorMode.colortype = LCT_PALETTE;
+    colorMode.bitdepth = 8;
+    for (size_t i = 0; i < rgb.size(); i += 3) {
+        lodepng_palette_add(&colorMode, rgb[i], rgb[i + 1], rgb[i + 2], 0xFF);
+    }
+}
+
+Palette::~Palette() {
+    lodepng_color_mode_cleanup(&colorMode);
+}
+
+std::mutex PaletteCache::mutex;
+std::map<std::string, PaletteCache::Entry> PaletteCache::entries;
+
+std::shared_ptr<const Palette> PaletteCache::load(const std::string &paletteFilename) {
+    std::error_code error;
+    auto modifiedTime = std::filesystem::last_write_time(paletteFilename, error);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = entries.find(paletteFilename);
+    if (!error && entry != entries.end() && entry->second.modifiedTime == modifiedTime) {
+        return entry->second.palette;
+    }
+
+    // loadFile() reports missing files.
+    auto palette = std::make_shared<const Palette>(loadFile(paletteFilename));
+    entries[paletteFilename] = {modifiedTime, palette};
+    return palette;
+}
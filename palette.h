@@ -0,0 +1,69 @@
+/*
+MIT License
+
+Copyright (c) 2023 Eric Fry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef TD3EXTRACT_PALETTE_H
+#define TD3EXTRACT_PALETTE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "lodepng.h"
+
+/* A game palette expanded to 8-bit RGB along with the matching PNG colour mode.
+ * Palettes are immutable once loaded so they can be shared between images and threads.
+ */
+class Palette {
+private:
+    std::vector<uint8_t> rgb;
+    LodePNGColorMode colorMode;
+
+public:
+    explicit Palette(const std::vector<uint8_t> &paletteFileData);
+    ~Palette();
+    Palette(const Palette &) = delete;
+    Palette &operator=(const Palette &) = delete;
+
+    const std::vector<uint8_t> &getRGB() const { return rgb; }
+    // An indexed 8-bit colour mode holding every palette entry. Copy it with lodepng_color_mode_copy().
+    const LodePNGColorMode &getColorMode() const { return colorMode; }
+};
+
+/* Loads each palette file once. Entries are keyed by path and reloaded if the file's modification time changes. */
+class PaletteCache {
+private:
+    struct Entry {
+        std::filesystem::file_time_type modifiedTime;
+        std::shared_ptr<const Palette> palette;
+    };
+    static std::mutex mutex;
+    static std::map<std::string, Entry> entries;
+
+public:
+    static std::shared_ptr<const Palette> load(const std::string &paletteFilename);
+};
+
+#endif //TD3EXTRACT_PALETTE_H
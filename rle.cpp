@@ -0,0 +1,144 @@
+/*
+MIT License
+
+Copyright (c) 2023 Eric Fry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <algorithm>
+#include <cstring>
+#include "rle.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef __SSE2__
+// Vector iterations between flushes of the running sums. Each lane gains at most 4 * 255 per iteration.
+constexpr size_t RLE_SUM_FLUSH_INTERVAL = 0x10000;
+#endif
+
+size_t getRLEUnpackedSize(const uint8_t *packedData, size_t packedSize) {
+    size_t numPairs = packedSize / 2;
+    size_t curPair = 0;
+    size_t numPixels = 0;
+
+#ifdef __SSE2__
+    // Shift each length byte down into the low half of its 16-bit lane then sum 8 pairs at a time.
+    // The sums are flushed often enough that each 64-bit lane stays below 32 bits, as _mm_cvtsi128_si64
+    // isn't available on 32-bit x86.
+    const __m128i zero = _mm_setzero_si128();
+    while (curPair + 8 <= numPairs) {
+        size_t blockEnd = std::min(numPairs, curPair + RLE_SUM_FLUSH_INTERVAL * 8);
+        __m128i sums = zero;
+        for (; curPair + 8 <= blockEnd; curPair += 8) {
+            __m128i pairs = _mm_loadu_si128(reinterpret_cast<const __m128i *>(packedData + curPair * 2));
+            sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_srli_epi16(pairs, 8), zero));
+        }
+        numPixels += (uint32_t)_mm_cvtsi128_si32(sums) + (uint32_t)_mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums));
+    }
+#endif
+
+    for (; curPair < numPairs; curPair++) {
+        numPixels += packedData[curPair * 2 + 1];
+    }
+    return numPixels;
+}
+
+// Writes a run. Short runs use a single 16 byte store when there is room for it past the end of the run.
+static inline void fillRun(uint8_t *out, uint8_t pixelValue, size_t runLength, size_t writableSize) {
+#ifdef __SSE2__
+    if (runLength <= 16 && writableSize >= 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_set1_epi8((char)pixelValue));
+        return;
+    }
+#endif
+    memset(out, pixelValue, runLength);
+}
+
+void unpackRLEData(const uint8_t *packedData, size_t packedSize, uint8_t *out) {
+    size_t outSize = getRLEUnpackedSize(packedData, packedSize);
+    size_t outPosition = 0;
+    for (size_t curPos = 0; curPos + 1 < packedSize; curPos += 2) {
+        uint8_t runLength = packedData[curPos + 1];
+        if (runLength == 0) {
+            continue;
+        }
+        // Any bytes written past the run are overwritten by the runs that follow.
+        fillRun(out + outPosition, packedData[curPos], runLength, outSize - outPosition);
+        outPosition += runLength;
+    }
+}
+
+void unpackRLERows(const uint8_t *packedData, size_t packedSize, uint8_t *firstRow, size_t rowWidth, ptrdiff_t rowStride) {
+    uint8_t *row = firstRow;
+    size_t x = 0;
+    for (size_t curPos = 0; curPos + 1 < packedSize; curPos += 2) {
+        uint8_t pixelValue = packedData[curPos];
+        size_t runLength = packedData[curPos + 1];
+
+        while (runLength > 0) {
+            // Runs can carry on into the next row. Stores never go past the end of the current row as
+            // the neighbouring row in memory may already have been written.
+            size_t count = std::min(runLength, rowWidth - x);
+            fillRun(row + x, pixelValue, count, rowWidth - x);
+            runLength -= count;
+            x += count;
+            if (x == rowWidth) {
+                x = 0;
+                row += rowStride;
+            }
+        }
+    }
+}
+
+/* Compares a block of bytes at a time against the run's pixel. The first zero bit of the
+ * equality mask is the end of the run, otherwise the whole block is skipped.
+ */
+size_t findRunEnd(const uint8_t *data, size_t position, size_t maxEnd) {
+    uint8_t pixelValue = data[position];
+    size_t curPos = position + 1;
+
+#ifdef __AVX2__
+    const __m256i pixels32 = _mm256_set1_epi8((char)pixelValue);
+    for (; curPos + 32 <= maxEnd; curPos += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + curPos));
+        uint32_t mismatches = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, pixels32));
+        if (mismatches != 0) {
+            return curPos + __builtin_ctz(mismatches);
+        }
+    }
+#endif
+#ifdef __SSE2__
+    const __m128i pixels16 = _mm_set1_epi8((char)pixelValue);
+    for (; curPos + 16 <= maxEnd; curPos += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + curPos));
+        uint32_t mismatches = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, pixels16)) & 0xffff;
+        if (mismatches != 0) {
+            return curPos + __builtin_ctz(mismatches);
+        }
+    }
+#endif
+
+    for (; curPos < maxEnd && data[curPos] == pixelValue; curPos++) {
+    }
+    return curPos;
+}
@@ -0,0 +1,47 @@
+/*
+MIT License
+
+Copyright (c) 2023 Eric Fry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef TD3EXTRACT_RLE_H
+#define TD3EXTRACT_RLE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/* The game's RLE format is a list of (pixel, length) byte pairs with runs of 1 to 255 pixels.
+ * Image rows are stored bottom up.
+ */
+
+// Returns the number of pixels the packed data expands to.
+size_t getRLEUnpackedSize(const uint8_t *packedData, size_t packedSize);
+
+// Expands packed data into out which must hold getRLEUnpackedSize() bytes.
+void unpackRLEData(const uint8_t *packedData, size_t packedSize, uint8_t *out);
+
+// Expands packed data into rows of rowWidth pixels. Each row starts rowStride bytes after the previous one,
+// so a negative stride writes the rows bottom up.
+void unpackRLERows(const uint8_t *packedData, size_t packedSize, uint8_t *firstRow, size_t rowWidth, ptrdiff_t rowStride);
+
+// Returns the position of the first byte in [position + 1, maxEnd) that differs from data[position], or maxEnd.
+size_t findRunEnd(const uint8_t *data, size_t position, size_t maxEnd);
+
+#endif //TD3EXTRACT_RLE_H